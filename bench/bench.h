@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+
+#include "verbar_internal.h"
+
+/* The benchmarks run without the main loop, so nothing needs to be woken. */
+void request_update(void)
+{
+}
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return timespec_to_ns(&tp);
+}
+
+/* Run callbacks until the workers have handed back everything queued. */
+static inline int drain_workers(int epoll_fd)
+{
+	struct epoll_event events[10];
+	int i, ret;
+
+	while (outstanding_work()) {
+		ret = epoll_wait(epoll_fd, events,
+				 sizeof(events) / sizeof(events[0]), -1);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			return -1;
+		}
+		for (i = 0; i < ret; i++) {
+			struct epoll_callback *cb = events[i].data.ptr;
+
+			if (cb->callback(cb->fd, cb->data, events[i].events))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Generate a fake /proc and /sys for benchmarking sections against (with
+ * verbar --root or bench/micro -R). The contents only depend on the options,
+ * so results are reproducible across machines.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define MAX_CPUS 1024
+
+/* The fields of /proc/meminfo as of Linux 6.x, in order. */
+static const char *meminfo_fields[] = {
+	"MemTotal", "MemFree", "MemAvailable", "Buffers", "Cached",
+	"SwapCached", "Active", "Inactive", "Active(anon)", "Inactive(anon)",
+	"Active(file)", "Inactive(file)", "Unevictable", "Mlocked",
+	"SwapTotal", "SwapFree", "Zswap", "Zswapped", "Dirty", "Writeback",
+	"AnonPages", "Mapped", "Shmem", "KReclaimable", "Slab",
+	"SReclaimable", "SUnreclaim", "KernelStack", "PageTables",
+	"SecPageTables", "NFS_Unstable", "Bounce", "WritebackTmp",
+	"CommitLimit", "Committed_AS", "VmallocTotal", "VmallocUsed",
+	"VmallocChunk", "Percpu", "HardwareCorrupted", "AnonHugePages",
+	"ShmemHugePages", "ShmemPmdMapped", "FileHugePages", "FilePmdMapped",
+	"Unaccepted", "HugePages_Total", "HugePages_Free", "HugePages_Rsvd",
+	"HugePages_Surp", "Hugepagesize", "Hugetlb", "DirectMap4k",
+	"DirectMap2M", "DirectMap1G",
+};
+
+static int mkdir_p(char *path)
+{
+	char *p = path;
+
+	for (;;) {
+		p = strchr(p + 1, '/');
+		if (p)
+			*p = '\0';
+		if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+			perror("mkdir");
+			return -1;
+		}
+		if (!p)
+			return 0;
+		*p = '/';
+	}
+}
+
+/* Open DIR/PATH for writing, creating its parent directories. */
+static FILE *create_file(const char *dir, const char *path)
+{
+	char buf[4096], *slash;
+	FILE *file;
+
+	if (snprintf(buf, sizeof(buf), "%s/%s", dir, path) >= sizeof(buf)) {
+		fprintf(stderr, "path is too long\n");
+		return NULL;
+	}
+	slash = strrchr(buf, '/');
+	*slash = '\0';
+	if (mkdir_p(buf))
+		return NULL;
+	*slash = '/';
+
+	file = fopen(buf, "w");
+	if (!file)
+		perror("fopen");
+	return file;
+}
+
+static int close_file(FILE *file)
+{
+	if (ferror(file) | fclose(file)) {
+		perror("fclose");
+		return -1;
+	}
+	return 0;
+}
+
+static int write_stat(const char *dir, unsigned int num_cpus)
+{
+	unsigned long long user, system, idle, total[3] = {0};
+	unsigned int i;
+	FILE *file;
+
+	file = create_file(dir, "proc/stat");
+	if (!file)
+		return -1;
+
+	/* Each CPU has been up for a day and busy for a varying fraction. */
+	for (i = 0; i < num_cpus; i++) {
+		user = 100000 + 7919 * (i % 64);
+		system = 20000 + 104729 % (i + 1);
+		idle = 8640000 - user - system;
+		total[0] += user;
+		total[1] += system;
+		total[2] += idle;
+	}
+	fprintf(file, "cpu  %llu 0 %llu %llu 0 0 0 0 0 0\n", total[0],
+		total[1], total[2]);
+	for (i = 0; i < num_cpus; i++) {
+		user = 100000 + 7919 * (i % 64);
+		system = 20000 + 104729 % (i + 1);
+		idle = 8640000 - user - system;
+		fprintf(file, "cpu%u %llu 0 %llu %llu 0 0 0 0 0 0\n", i, user,
+			system, idle);
+	}
+	fprintf(file, "intr 123456789");
+	for (i = 0; i < 256; i++)
+		fprintf(file, " %u", i % 7 ? 0 : 1000 * i);
+	fprintf(file, "\nctxt 987654321\n"
+		"btime 1767225600\n"
+		"processes 123456\n"
+		"procs_running 1\n"
+		"procs_blocked 0\n"
+		"softirq 12345678 0 1 2 3 4 5 6 7 8 9\n");
+	return close_file(file);
+}
+
+static int write_meminfo(const char *dir, unsigned int num_lines)
+{
+	const unsigned long long total = 16ULL * 1024 * 1024;
+	unsigned int i, num_fields;
+	FILE *file;
+
+	file = create_file(dir, "proc/meminfo");
+	if (!file)
+		return -1;
+
+	num_fields = sizeof(meminfo_fields) / sizeof(*meminfo_fields);
+	for (i = 0; i < num_fields || i < num_lines; i++) {
+		unsigned long long value;
+
+		if (i == 0)
+			value = total;
+		else if (i == 2)
+			value = total / 4;
+		else
+			value = (total >> (i % 16)) + i;
+
+		/* Past the real fields, pad with made up ones. */
+		if (i < num_fields) {
+			fprintf(file, "%s:", meminfo_fields[i]);
+			fprintf(file, "%*llu kB\n",
+				(int)(24 - strlen(meminfo_fields[i])), value);
+		} else {
+			fprintf(file, "Extra%u: %14llu kB\n", i, value);
+		}
+	}
+	return close_file(file);
+}
+
+static int write_attr(const char *dir, const char *supply, const char *attr,
+		      const char *value)
+{
+	char path[256];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "sys/class/power_supply/%s/%s", supply,
+		 attr);
+	file = create_file(dir, path);
+	if (!file)
+		return -1;
+	fprintf(file, "%s\n", value);
+	return close_file(file);
+}
+
+static int write_power_supplies(const char *dir, unsigned int num_batteries)
+{
+	char name[32], capacity[16];
+	unsigned int i;
+
+	if (write_attr(dir, "AC", "type", "Mains") ||
+	    write_attr(dir, "AC", "online", "0"))
+		return -1;
+	for (i = 0; i < num_batteries; i++) {
+		snprintf(name, sizeof(name), "BAT%u", i);
+		snprintf(capacity, sizeof(capacity), "%u", 100 - 13 * i % 100);
+		if (write_attr(dir, name, "type", "Battery") ||
+		    write_attr(dir, name, "status", "Discharging") ||
+		    write_attr(dir, name, "capacity", capacity))
+			return -1;
+	}
+	return 0;
+}
+
+static void usage(bool error)
+{
+	fprintf(error ? stderr : stdout,
+		"usage: fixture [-c CPUS] [-m LINES] [-b BATTERIES] DIR\n"
+		"\n"
+		"Write a fake /proc and /sys under DIR\n"
+		"\n"
+		"Options:\n"
+		"  -c CPUS       number of CPUs in /proc/stat (1-%d, default: 8)\n"
+		"  -m LINES      pad /proc/meminfo to LINES lines\n"
+		"  -b BATTERIES  number of batteries besides AC (default: 1)\n",
+		MAX_CPUS);
+	exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long num_cpus = 8, num_lines = 0, num_batteries = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:m:b:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			num_cpus = strtoul(optarg, NULL, 0);
+			if (num_cpus < 1 || num_cpus > MAX_CPUS)
+				usage(true);
+			break;
+		case 'm':
+			num_lines = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			num_batteries = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(false);
+		default:
+			usage(true);
+		}
+	}
+	if (optind != argc - 1)
+		usage(true);
+
+	if (write_stat(argv[optind], num_cpus) ||
+	    write_meminfo(argv[optind], num_lines) ||
+	    write_power_supplies(argv[optind], num_batteries))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
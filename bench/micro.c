@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Micro-benchmarks for every section linked in: call timer_update and append
+ * in a loop and report the time, system calls, and allocations per call. Then
+ * do the same for the str builder and for whole frames (updating every due
+ * section and formatting the status bar, which goes nowhere instead of to X).
+ *
+ * System calls are counted with the raw_syscalls:sys_enter tracepoint, which
+ * needs tracefs and permission to use perf events; otherwise they're reported
+ * as "-". Allocations are counted by wrapping malloc() and friends.
+ */
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include "bench.h"
+
+#define DEFAULT_ITERATIONS 10000
+
+static const char *tracepoint_paths[] = {
+	"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+	"/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+};
+
+/* One perf event per thread counting system calls. */
+static int *syscall_fds;
+static size_t num_syscall_fds;
+static bool count_syscalls;
+
+static unsigned long num_allocs;
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	__atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+static void close_syscall_counters(void)
+{
+	size_t i;
+
+	for (i = 0; i < num_syscall_fds; i++)
+		close(syscall_fds[i]);
+	free(syscall_fds);
+	syscall_fds = NULL;
+	num_syscall_fds = 0;
+	count_syscalls = false;
+}
+
+static int open_syscall_counter(long long id, pid_t tid)
+{
+	struct perf_event_attr attr;
+	int *tmp;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.size = sizeof(attr);
+	attr.config = id;
+	fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1,
+		     PERF_FLAG_FD_CLOEXEC);
+	if (fd == -1)
+		return 0;
+
+	tmp = realloc(syscall_fds, (num_syscall_fds + 1) * sizeof(*tmp));
+	if (!tmp) {
+		perror("realloc");
+		close(fd);
+		return -1;
+	}
+	syscall_fds = tmp;
+	syscall_fds[num_syscall_fds++] = fd;
+	return 1;
+}
+
+/*
+ * Count system calls made by every thread that currently exists, so this must
+ * be called again after threads are started.
+ */
+static int open_syscall_counters(void)
+{
+	struct dirent *ent;
+	long long id = -1;
+	size_t i;
+	DIR *dir;
+	int ret;
+
+	close_syscall_counters();
+
+	for (i = 0; i < sizeof(tracepoint_paths) / sizeof(*tracepoint_paths);
+	     i++) {
+		if (access(tracepoint_paths[i], R_OK) == 0 &&
+		    parse_int_file(tracepoint_paths[i], &id) == 0)
+			break;
+	}
+	if (id < 0)
+		return 0;
+
+	dir = opendir("/proc/self/task");
+	if (!dir) {
+		perror("opendir(\"/proc/self/task\")");
+		return -1;
+	}
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.')
+			continue;
+		ret = open_syscall_counter(id, atoi(ent->d_name));
+		if (ret <= 0) {
+			/* Either every thread is counted or none are. */
+			closedir(dir);
+			close_syscall_counters();
+			return ret;
+		}
+	}
+	closedir(dir);
+	count_syscalls = true;
+	return 0;
+}
+
+struct sample {
+	uint64_t ns;
+	uint64_t syscalls;
+	unsigned long allocs;
+};
+
+static void take_sample(struct sample *sample)
+{
+	uint64_t count;
+	size_t i;
+
+	sample->syscalls = 0;
+	for (i = 0; i < num_syscall_fds; i++) {
+		if (read(syscall_fds[i], &count, sizeof(count)) ==
+		    sizeof(count))
+			sample->syscalls += count;
+	}
+	sample->allocs = __atomic_load_n(&num_allocs, __ATOMIC_RELAXED);
+	/* Last so that reading the counters isn't timed. */
+	sample->ns = now_ns();
+}
+
+static void report(const char *name, const char *op,
+		   const struct sample *start, unsigned long iterations)
+{
+	struct sample end;
+	char syscalls[32];
+	uint64_t end_ns;
+
+	end_ns = now_ns();
+	take_sample(&end);
+
+	if (count_syscalls) {
+		/* Don't count the reads in take_sample(). */
+		snprintf(syscalls, sizeof(syscalls), "%.2f",
+			 (double)(end.syscalls - start->syscalls -
+				  num_syscall_fds) / iterations);
+	} else {
+		strcpy(syscalls, "-");
+	}
+	printf("%-10s %-8s %12.1f %12s %12.2f\n", name, op,
+	       (double)(end_ns - start->ns) / iterations, syscalls,
+	       (double)(end.allocs - start->allocs) / iterations);
+}
+
+/*
+ * Benchmark one section. Returns 1 if it works, 0 if it had to be skipped, or
+ * -1 on error.
+ */
+static int bench_section(const struct section *section, int epoll_fd,
+			 unsigned long iterations)
+{
+	static char * const no_options[] = {NULL};
+	struct str str = {NULL};
+	struct sample start;
+	void *data = NULL;
+	unsigned long i;
+	int ret;
+
+	if (section->init) {
+		data = section->init(epoll_fd, no_options);
+		if (!data) {
+			printf("%-10s init failed\n", section->name);
+			return 0;
+		}
+	}
+
+	if (section->timer_update) {
+		/* The first update may be different (e.g., opening files). */
+		ret = section->timer_update(data);
+		if (ret < 0) {
+			printf("%-10s %s\n", section->name,
+			       ret == SECTION_UNAVAILABLE ? "unavailable" :
+			       "update failed");
+			ret = 0;
+			goto out;
+		}
+
+		take_sample(&start);
+		for (i = 0; i < iterations; i++) {
+			if (section->timer_update(data) < 0) {
+				fprintf(stderr, "%s: update failed\n",
+					section->name);
+				ret = -1;
+				goto out;
+			}
+		}
+		report(section->name, "update", &start, iterations);
+	}
+
+	take_sample(&start);
+	for (i = 0; i < iterations; i++) {
+		str.len = 0;
+		if (section->append(data, &str, false)) {
+			fprintf(stderr, "%s: append failed\n", section->name);
+			ret = -1;
+			goto out;
+		}
+	}
+	report(section->name, "append", &start, iterations);
+	ret = 1;
+
+out:
+	if (section->free)
+		section->free(data);
+	str_free(&str);
+	return ret;
+}
+
+static int bench_str(unsigned long iterations)
+{
+	struct str str = {NULL};
+	struct sample start;
+	unsigned long i;
+	int ret = 0;
+
+	take_sample(&start);
+	for (i = 0; i < iterations; i++) {
+		str.len = 0;
+		if (str_append_icon(&str, "cpu") ||
+		    str_appendf(&str, "%3lu%%", i % 100) ||
+		    str_separator(&str) ||
+		    str_append_escaped(&str, "\"my network\"", 12) ||
+		    str_null_terminate(&str)) {
+			ret = -1;
+			goto out;
+		}
+	}
+	report("str", "build", &start, iterations);
+out:
+	str_free(&str);
+	return ret;
+}
+
+static int bench_frame(int epoll_fd, const struct section_config *config,
+		       size_t count, unsigned long iterations)
+{
+	struct str status_str = {NULL}, prev_status_str = {NULL}, tmp;
+	struct sample start;
+	struct timespec tp;
+	unsigned long i;
+	int ret;
+
+	if (init_sections(epoll_fd, config, count) || drain_workers(epoll_fd))
+		goto err;
+	/* The workers exist now. */
+	if (open_syscall_counters())
+		goto err;
+
+	take_sample(&start);
+	for (i = 0; i < iterations; i++) {
+		if (verbar_clock_gettime(timer_clockid(), &tp)) {
+			perror("clock_gettime");
+			goto err;
+		}
+		reset_timer_sections();
+		if (update_timer_sections(timespec_to_ns(&tp)) < 0 ||
+		    drain_workers(epoll_fd))
+			goto err;
+		ret = format_statusbar(&status_str, &prev_status_str, false,
+				       NULL);
+		if (ret < 0)
+			goto err;
+		if (ret) {
+			tmp = prev_status_str;
+			prev_status_str = status_str;
+			status_str = tmp;
+		}
+	}
+	report("frame", "update", &start, iterations);
+	ret = 0;
+	goto out;
+
+err:
+	ret = -1;
+out:
+	free_sections();
+	str_free(&status_str);
+	str_free(&prev_status_str);
+	return ret;
+}
+
+static void usage(bool error)
+{
+	fprintf(error ? stderr : stdout,
+		"usage: micro [-n ITERATIONS] [-R DIR] [SECTION...]\n"
+		"\n"
+		"Benchmark the given sections (by default, every one linked in),\n"
+		"reading /proc and /sys under DIR if given (see bench/fixture).\n");
+	exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+	static char default_sections[] = BENCH_SECTIONS;
+	unsigned long iterations = DEFAULT_ITERATIONS;
+	struct section_config *config = NULL;
+	char *names[64], *saveptr, *name;
+	const struct section *section;
+	size_t num_names = 0, count = 0, i;
+	int status = EXIT_FAILURE;
+	int epoll_fd, opt, ret;
+
+	while ((opt = getopt(argc, argv, "n:R:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			if (!iterations)
+				usage(true);
+			break;
+		case 'R':
+			host_root = optarg;
+			break;
+		case 'h':
+			usage(false);
+		default:
+			usage(true);
+		}
+	}
+	if (optind < argc) {
+		for (; optind < argc && num_names < 64; optind++)
+			names[num_names++] = argv[optind];
+	} else {
+		for (name = strtok_r(default_sections, " ", &saveptr);
+		     name && num_names < 64;
+		     name = strtok_r(NULL, " ", &saveptr))
+			names[num_names++] = name;
+	}
+
+	/* Sections may fork (e.g., volume), so don't leave output buffered. */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	/* Exercise the icon paths too. */
+	icon_path = "icons";
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		perror("epoll_create1");
+		return EXIT_FAILURE;
+	}
+	config = calloc(num_names, sizeof(*config));
+	if (!config) {
+		perror("calloc");
+		goto out;
+	}
+	if (open_syscall_counters())
+		goto out;
+
+	printf("%-10s %-8s %12s %12s %12s\n", "section", "op", "ns/op",
+	       "syscalls/op", "allocs/op");
+	for (i = 0; i < num_names; i++) {
+		section = find_section(names[i]);
+		if (!section) {
+			fprintf(stderr, "unknown section \"%s\"\n", names[i]);
+			goto out;
+		}
+		ret = bench_section(section, epoll_fd, iterations);
+		if (ret < 0)
+			goto out;
+		/* Only put sections that work in the frame. */
+		if (ret)
+			config[count++].name = names[i];
+	}
+	if (bench_str(iterations) || bench_frame(epoll_fd, config, count,
+						 iterations))
+		goto out;
+	status = EXIT_SUCCESS;
+out:
+	close_syscall_counters();
+	free(config);
+	close(epoll_fd);
+	return status;
+}
@@ -0,0 +1,542 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Soak test: run verbar's main loop on the virtual clock against a fake /proc
+ * and /sys (see bench/fixture.c), skipping straight to each deadline instead of
+ * sleeping, so that weeks of operation go by in seconds. The status bar is
+ * rendered to stdout, which is redirected to /dev/null. Every so often, a soak
+ * section reports the heap size, RSS, open file descriptors, and the cost of
+ * each wakeup so that leaks and slowdowns show up as growth between
+ * checkpoints, and then refreshes every section through the control socket.
+ * After the first checkpoint, the status bar is switched to wordy output, and
+ * the control socket must still report the terse output of the soak section
+ * as of the last checkpoint. Fails if that doesn't hold, file descriptors
+ * leaked, or the main loop stalled.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "verbar.h"
+#include "verbar_internal.h"
+
+#define DEFAULT_WAKEUPS 1000000
+#define NUM_CHECKPOINTS 10
+/* Real seconds without a checkpoint after which the main loop is stuck. */
+#define STALL_TIMEOUT 60
+
+/* main.c, compiled with main renamed. */
+int verbar_main(int argc, char **argv);
+
+/*
+ * Section that rebuilds a list of strdup()'d names on every update, with the
+ * length of the list changing over time, like net does with its NICs.
+ */
+struct churn_item {
+	char *name;
+	struct churn_item *next;
+};
+
+struct churn_section {
+	struct churn_item *items;
+	unsigned long generation;
+};
+
+static void free_churn_items(struct churn_item *item)
+{
+	struct churn_item *next;
+
+	while (item) {
+		next = item->next;
+		free(item->name);
+		free(item);
+		item = next;
+	}
+}
+
+static void *churn_init(int epoll_fd, char * const *options)
+{
+	struct churn_section *section;
+
+	section = calloc(1, sizeof(*section));
+	if (!section)
+		perror("calloc");
+	return section;
+}
+
+static void churn_free(void *data)
+{
+	struct churn_section *section = data;
+
+	free_churn_items(section->items);
+	free(section);
+}
+
+static int churn_update(void *data)
+{
+	struct churn_section *section = data;
+	struct churn_item *items = NULL, *item;
+	char name[32];
+	unsigned int i, count;
+
+	section->generation++;
+	count = section->generation % 8;
+	for (i = 0; i < count; i++) {
+		item = malloc(sizeof(*item));
+		if (!item) {
+			perror("malloc");
+			goto err;
+		}
+		snprintf(name, sizeof(name), "if%lu", section->generation + i);
+		item->name = strdup(name);
+		if (!item->name) {
+			perror("strdup");
+			free(item);
+			goto err;
+		}
+		item->next = items;
+		items = item;
+	}
+	free_churn_items(section->items);
+	section->items = items;
+	return 1;
+
+err:
+	free_churn_items(items);
+	return -1;
+}
+
+static int churn_append(void *data, struct str *str, bool wordy)
+{
+	struct churn_section *section = data;
+	struct churn_item *item;
+
+	for (item = section->items; item; item = item->next) {
+		if (str_append(str, item->name) || str_separator(str))
+			return -1;
+	}
+	return 0;
+}
+
+static const struct section churn_section = {
+	.name = "churn",
+	.init = churn_init,
+	.free = churn_free,
+	.timer_update = churn_update,
+	.append = churn_append,
+	.period = 1000,
+};
+register_section(churn_section);
+
+struct checkpoint {
+	uint64_t wakeups;
+	uint64_t virtual_ns;
+	size_t heap;
+	size_t rss;
+	unsigned int fds;
+	double mean_wakeup_ns;
+	uint64_t max_second_ns;
+};
+
+/* Where the report goes, since stdout is the status bar. */
+static FILE *report;
+
+static uint64_t max_wakeups = DEFAULT_WAKEUPS, window;
+static struct checkpoint first, last;
+static unsigned int num_checkpoints;
+static bool failed;
+
+static struct sockaddr_un control_addr = {
+	.sun_family = AF_UNIX,
+};
+static int control_fd = -1;
+
+static uint64_t now_ns(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return timespec_to_ns(&tp);
+}
+
+static uint64_t virtual_now(void)
+{
+	struct timespec tp;
+
+	verbar_clock_gettime(timer_clockid(), &tp);
+	return timespec_to_ns(&tp);
+}
+
+static uint64_t get_wakeups(void)
+{
+	return __atomic_load_n(&self_stats.wakeups, __ATOMIC_RELAXED);
+}
+static int count_fds(unsigned int *ret)
+{
+	struct dirent *ent;
+	unsigned int count = 0;
+	DIR *dir;
+
+	dir = opendir("/proc/self/fd");
+	if (!dir) {
+		perror("opendir(\"/proc/self/fd\")");
+		return -1;
+	}
+	while ((errno = 0, ent = readdir(dir))) {
+		if (ent->d_name[0] != '.')
+			count++;
+	}
+	if (errno) {
+		perror("readdir");
+		closedir(dir);
+		return -1;
+	}
+	closedir(dir);
+	/* Don't count the directory itself. */
+	*ret = count - 1;
+	return 0;
+}
+
+static int get_rss(size_t *ret)
+{
+	unsigned long size, resident;
+	FILE *file;
+	int n;
+
+	file = fopen("/proc/self/statm", "r");
+	if (!file) {
+		perror("fopen(\"/proc/self/statm\")");
+		return -1;
+	}
+	n = fscanf(file, "%lu %lu", &size, &resident);
+	fclose(file);
+	if (n != 2) {
+		fprintf(stderr, "could not parse /proc/self/statm\n");
+		return -1;
+	}
+	*ret = resident * sysconf(_SC_PAGESIZE);
+	return 0;
+}
+
+static int take_checkpoint(struct checkpoint *checkpoint)
+{
+	struct mallinfo2 info = mallinfo2();
+
+	checkpoint->heap = info.uordblks + info.hblkhd;
+	if (get_rss(&checkpoint->rss) || count_fds(&checkpoint->fds))
+		return -1;
+	return 0;
+}
+
+static void print_checkpoint(const struct checkpoint *checkpoint)
+{
+	double days = (double)checkpoint->virtual_ns / NSEC_PER_SEC / 86400;
+
+	fprintf(report, "%10" PRIu64 " %8.2f %10zu %10zu %5u %10.1f %10.1f\n",
+		checkpoint->wakeups, days, checkpoint->heap / 1024,
+		checkpoint->rss / 1024, checkpoint->fds,
+		checkpoint->mean_wakeup_ns / 1000,
+		(double)checkpoint->max_second_ns / 1000);
+	fflush(report);
+}
+
+/*
+ * Make every section due immediately through the control socket, like after a
+ * resume, and get the output of the soak section. The reply is checked by
+ * check_reply() at the next checkpoint.
+ */
+static int send_refresh(void)
+{
+	static const char command[] = "refresh\nget soak\n";
+
+	control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (control_fd == -1) {
+		perror("socket");
+		return -1;
+	}
+	if (connect(control_fd, (struct sockaddr *)&control_addr,
+		    sizeof(control_addr)) == -1) {
+		perror("connect(control)");
+		return -1;
+	}
+	if (write(control_fd, command, sizeof(command) - 1) !=
+	    sizeof(command) - 1) {
+		perror("write(control)");
+		return -1;
+	}
+	/* Let verbar close its end once it has replied. */
+	if (shutdown(control_fd, SHUT_WR) == -1) {
+		perror("shutdown(control)");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Check that the reply to send_refresh() showed the checkpoint it was sent at.
+ * verbar has long since replied and closed its end, so this doesn't block.
+ */
+static int check_reply(void)
+{
+	char buf[256], expected[32];
+	size_t len = 0;
+	ssize_t sret;
+
+	while ((sret = recv(control_fd, buf + len, sizeof(buf) - 1 - len,
+			    MSG_DONTWAIT)) > 0)
+		len += sret;
+	if (sret == -1) {
+		perror("recv(control)");
+		return -1;
+	}
+	buf[len] = '\0';
+	close(control_fd);
+	control_fd = -1;
+
+	snprintf(expected, sizeof(expected), "\tsoak %u\n", num_checkpoints);
+	if (!strstr(buf, expected)) {
+		fprintf(stderr, "get soak returned stale output:\n%s", buf);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Section that takes the checkpoints once a (virtual) second and stops verbar
+ * after enough wakeups of the main loop.
+ */
+struct soak_section {
+	uint64_t start;
+	uint64_t window_start, window_wakeups, next_checkpoint;
+	uint64_t last_update, max_second_ns;
+};
+
+static void *soak_init(int epoll_fd, char * const *options)
+{
+	struct soak_section *section;
+
+	section = calloc(1, sizeof(*section));
+	if (!section) {
+		perror("calloc");
+		return NULL;
+	}
+	section->start = virtual_now();
+	section->window_start = section->last_update = now_ns();
+	section->window_wakeups = get_wakeups();
+	section->next_checkpoint = section->window_wakeups + window;
+	return section;
+}
+
+static void soak_free(void *data)
+{
+	free(data);
+}
+
+static int soak_update(void *data)
+{
+	struct soak_section *section = data;
+	uint64_t now = now_ns(), wakeups = get_wakeups();
+
+	if (now - section->last_update > section->max_second_ns)
+		section->max_second_ns = now - section->last_update;
+	if (wakeups >= section->next_checkpoint) {
+		if (control_fd != -1 && check_reply()) {
+			failed = true;
+			raise(SIGTERM);
+			return -1;
+		}
+		last.wakeups = wakeups;
+		last.virtual_ns = virtual_now() - section->start;
+		last.mean_wakeup_ns =
+			(double)(now - section->window_start) /
+			(wakeups - section->window_wakeups);
+		last.max_second_ns = section->max_second_ns;
+		if (take_checkpoint(&last)) {
+			failed = true;
+			raise(SIGTERM);
+			return -1;
+		}
+		print_checkpoint(&last);
+		if (!num_checkpoints++) {
+			first = last;
+			/* Only the wordy output is rendered from now on. */
+			raise(SIGUSR1);
+		}
+		if (send_refresh()) {
+			failed = true;
+			raise(SIGTERM);
+			return -1;
+		}
+		if (wakeups >= max_wakeups)
+			raise(SIGTERM);
+		alarm(STALL_TIMEOUT);
+
+		section->next_checkpoint += window;
+		section->window_wakeups = wakeups;
+		section->max_second_ns = 0;
+		/* Don't count the checkpoint itself. */
+		section->window_start = now_ns();
+		section->last_update = now_ns();
+		return 1;
+	}
+	section->last_update = now_ns();
+	return 0;
+}
+
+/* Show which checkpoint was taken last. */
+static int soak_append(void *data, struct str *str, bool wordy)
+{
+	if (str_appendf(str, "soak %u", num_checkpoints))
+		return -1;
+	return str_separator(str);
+}
+
+static const struct section soak_section = {
+	.name = "soak",
+	.init = soak_init,
+	.free = soak_free,
+	.timer_update = soak_update,
+	.append = soak_append,
+	.period = 1000,
+};
+register_section(soak_section);
+
+static int write_config(const char *path)
+{
+	FILE *file;
+
+	file = fopen(path, "w");
+	if (!file) {
+		perror("fopen(config)");
+		return -1;
+	}
+	fputs("cpu\nmem\npower\ndropbox\nchurn\nverbar\nclock\nsoak\n", file);
+	if (fclose(file) == EOF) {
+		perror("fclose(config)");
+		return -1;
+	}
+	return 0;
+}
+
+/* Keep the real stdout for the report and send the status bar to /dev/null. */
+static int redirect_stdout(void)
+{
+	int fd;
+
+	fd = dup(STDOUT_FILENO);
+	if (fd == -1) {
+		perror("dup");
+		return -1;
+	}
+	report = fdopen(fd, "w");
+	if (!report) {
+		perror("fdopen");
+		close(fd);
+		return -1;
+	}
+	fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (fd == -1) {
+		perror("open(\"/dev/null\")");
+		return -1;
+	}
+	if (dup2(fd, STDOUT_FILENO) == -1) {
+		perror("dup2");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char config_path[PATH_MAX];
+	char *verbar_argv[] = {
+		"verbar", "-R", NULL, "-f", config_path, "-c",
+		control_addr.sun_path, "-o", "stdout", "-r", "0", NULL,
+	};
+
+	if (argc < 2 || argc > 3 ||
+	    (argc == 3 && !(max_wakeups = strtoull(argv[2], NULL, 0)))) {
+		fprintf(stderr, "usage: %s ROOT [WAKEUPS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	window = max_wakeups / NUM_CHECKPOINTS;
+	if (!window)
+		window = 1;
+
+	verbar_argv[2] = argv[1];
+	if (snprintf(config_path, sizeof(config_path), "%s/soak.config",
+		     argv[1]) >= sizeof(config_path)) {
+		fprintf(stderr, "path is too long\n");
+		return EXIT_FAILURE;
+	}
+	if (write_config(config_path))
+		return EXIT_FAILURE;
+	if (snprintf(control_addr.sun_path, sizeof(control_addr.sun_path),
+		     "%s/control", argv[1]) >= sizeof(control_addr.sun_path)) {
+		fprintf(stderr, "path is too long\n");
+		return EXIT_FAILURE;
+	}
+	/* Don't talk to a real Dropbox daemon. */
+	if (setenv("HOME", argv[1], 1) == -1) {
+		perror("setenv");
+		return EXIT_FAILURE;
+	}
+	if (redirect_stdout() || enable_virtual_clock())
+		return EXIT_FAILURE;
+
+	fprintf(report, "%10s %8s %10s %10s %5s %10s %10s\n", "wakeups",
+		"days", "heap KiB", "RSS KiB", "fds", "us/wakeup", "max us/s");
+	fflush(report);
+	/* Die if the main loop stops waking up (e.g., a disarmed timer). */
+	alarm(STALL_TIMEOUT);
+	if (verbar_main(sizeof(verbar_argv) / sizeof(verbar_argv[0]) - 1,
+			verbar_argv) != EXIT_SUCCESS || failed)
+		return EXIT_FAILURE;
+	if (num_checkpoints < 2) {
+		fprintf(stderr, "verbar exited before the soak finished\n");
+		return EXIT_FAILURE;
+	}
+
+	/* The first window includes warming up, so compare against its end. */
+	fprintf(report,
+		"growth since first checkpoint: heap %+ld KiB, RSS %+ld KiB, "
+		"fds %+d, mean wakeup latency %.2fx\n",
+		((long)last.heap - (long)first.heap) / 1024,
+		((long)last.rss - (long)first.rss) / 1024,
+		(int)last.fds - (int)first.fds,
+		last.mean_wakeup_ns / first.mean_wakeup_ns);
+	fclose(report);
+	if (last.fds != first.fds) {
+		fprintf(stderr, "file descriptors leaked\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measure what the section machinery itself costs per tick: scheduling, the
+ * update and append calls, and building the status string. The sections are
+ * trivial counters so that the cost of sampling doesn't drown it out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define DEFAULT_TICKS 1000000
+
+static unsigned int counter;
+
+static int counter_update(void *data)
+{
+	counter++;
+	return 1;
+}
+
+static int counter_append(void *data, struct str *str, bool wordy)
+{
+	if (str_appendf(str, "%u", counter))
+		return -1;
+	return str_separator(str);
+}
+
+static const struct section counter_section = {
+	.name = "counter",
+	.timer_update = counter_update,
+	.append = counter_append,
+};
+register_section(counter_section);
+
+int main(int argc, char **argv)
+{
+	const struct section_config config[] = {
+		{"counter"}, {"counter"}, {"counter"}, {"counter"},
+		{"counter"}, {"counter"}, {"counter"}, {"counter"},
+	};
+	size_t num_sections = sizeof(config) / sizeof(*config);
+	unsigned long ticks = DEFAULT_TICKS, i;
+	struct str str = {NULL};
+	uint64_t start, elapsed;
+	int epoll_fd;
+
+	if (argc > 1)
+		ticks = strtoul(argv[1], NULL, 0);
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		perror("epoll_create1");
+		return EXIT_FAILURE;
+	}
+	if (init_sections(epoll_fd, config, num_sections))
+		return EXIT_FAILURE;
+
+	start = now_ns();
+	for (i = 0; i < ticks; i++) {
+		/* Make every section due, update them, and render. */
+		reset_timer_sections();
+		if (update_timer_sections(i + 1) < 0)
+			return EXIT_FAILURE;
+		str.len = 0;
+		if (append_sections(&str, false, NULL))
+			return EXIT_FAILURE;
+	}
+	elapsed = now_ns() - start;
+
+	printf("%lu ticks of %zu sections: %.1f ns/tick, %.1f ns/section\n",
+	       ticks, num_sections, (double)elapsed / ticks,
+	       (double)elapsed / ticks / num_sections);
+
+	free_sections();
+	str_free(&str);
+	close(epoll_fd);
+	return EXIT_SUCCESS;
+}
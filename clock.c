@@ -17,13 +17,106 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "verbar.h"
 
+static const char *default_format = " %a, %b %d %I:%M:%S %p";
+
+struct clock_section {
+	/* strftime() format, set with the "format" option. */
+	char *format;
+
+	/* Time that is currently displayed. */
+	time_t t;
+
+	/* Does the format include seconds or only minutes? */
+	unsigned int granularity;
+};
+
+static bool format_has_seconds(const char *format)
+{
+	const char *p;
+
+	for (p = format; (p = strchr(p, '%')); p++) {
+		p++;
+		while (*p == 'E' || *p == 'O')
+			p++;
+		if (*p && strchr("crsSTX+", *p))
+			return true;
+		if (!*p)
+			break;
+	}
+	return false;
+}
+
+static void *clock_init(int epoll_fd, char * const *options)
+{
+	struct clock_section *section;
+	const char *format;
+
+	section = malloc(sizeof(*section));
+	if (!section) {
+		perror("malloc");
+		return NULL;
+	}
+	format = section_option(options, "format");
+	section->format = strdup(format ? format : default_format);
+	if (!section->format) {
+		perror("strdup");
+		free(section);
+		return NULL;
+	}
+	section->t = (time_t)-1;
+	section->granularity = format_has_seconds(section->format) ? 1 : 60;
+	return section;
+}
+
+static void clock_free(void *data)
+{
+	struct clock_section *section = data;
+
+	free(section->format);
+	free(section);
+}
+
+static int clock_update(void *data)
+{
+	struct clock_section *section = data;
+	struct timespec tp;
+
+	/*
+	 * time() may use a coarse clock which lags behind the boundary that
+	 * clock_next_change() computed.
+	 */
+	if (verbar_clock_gettime(CLOCK_REALTIME, &tp)) {
+		perror("clock_gettime");
+		return -1;
+	}
+	if (tp.tv_sec / section->granularity ==
+	    section->t / section->granularity)
+		return 0;
+	section->t = tp.tv_sec;
+	return 1;
+}
+
+static uint64_t clock_next_change(void *data)
+{
+	struct clock_section *section = data;
+	struct timespec tp;
+
+	if (verbar_clock_gettime(CLOCK_REALTIME, &tp)) {
+		perror("clock_gettime");
+		return NSEC_PER_SEC;
+	}
+	return ((section->granularity - tp.tv_sec % section->granularity) *
+		NSEC_PER_SEC - tp.tv_nsec);
+}
+
 static int clock_append(void *data, struct str *str, bool wordy)
 {
-	time_t t;
+	struct clock_section *section = data;
 	struct tm tm;
 	char buf[100];
 	size_t sret;
@@ -31,16 +124,11 @@ static int clock_append(void *data, struct str *str, bool wordy)
 	if (str_append_icon(str, "clock"))
 		return -1;
 
-	t = time(NULL);
-	if (t == (time_t)-1) {
-		perror("time");
-		return -1;
-	}
-	if (!localtime_r(&t, &tm)) {
+	if (!localtime_r(&section->t, &tm)) {
 		perror("localtime_r");
 		return -1;
 	}
-	sret = strftime(buf, sizeof(buf), " %a, %b %d %I:%M:%S %p", &tm);
+	sret = strftime(buf, sizeof(buf), section->format, &tm);
 	if (sret == 0) {
 		perror("strftime");
 		return -1;
@@ -51,6 +139,10 @@ static int clock_append(void *data, struct str *str, bool wordy)
 
 static const struct section clock_section = {
 	.name = "clock",
+	.init = clock_init,
+	.free = clock_free,
+	.timer_update = clock_update,
+	.next_change = clock_next_change,
 	.append = clock_append,
 };
 register_section(clock_section);
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+
+#include "config.h"
+#include "verbar_internal.h"
+
+static const char * const default_sections[] = {
+	"dropbox",
+	"net",
+	"volume",
+	"cpu",
+	"mem",
+	"power",
+	"clock",
+};
+
+/* Path of the configuration file and its directory, which is watched. */
+static char *config_path;
+static char *config_dir;
+static const char *config_name;
+
+static int inotify_callback(int fd, void *data, uint32_t events);
+
+static struct epoll_callback inotify_cb = {
+	.callback = inotify_callback,
+	.fd = -1,
+	.name = "inotify",
+};
+
+static void free_section_configs(struct section_config *sections,
+				 size_t count)
+{
+	size_t i;
+	char **option;
+
+	for (i = 0; i < count; i++) {
+		free(sections[i].name);
+		if (sections[i].options) {
+			for (option = sections[i].options; *option; option++)
+				free(*option);
+			free(sections[i].options);
+		}
+	}
+	free(sections);
+}
+
+/*
+ * Split off the next whitespace-separated token, removing double quotes.
+ * Returns NULL at the end of the line or on a comment, and sets *error if a
+ * quote isn't closed.
+ */
+static char *next_token(char **p, bool *error)
+{
+	char *s = *p, *token, *out;
+
+	s += strspn(s, " \t\n");
+	if (!*s || *s == '#')
+		return NULL;
+
+	token = out = s;
+	while (*s && !strchr(" \t\n", *s)) {
+		if (*s == '"') {
+			s++;
+			while (*s && *s != '"')
+				*out++ = *s++;
+			if (!*s) {
+				*error = true;
+				return NULL;
+			}
+			s++;
+		} else {
+			*out++ = *s++;
+		}
+	}
+	if (*s)
+		s++;
+	*out = '\0';
+	*p = s;
+	return token;
+}
+
+static int parse_line(char *line, struct section_config *config,
+		      size_t lineno)
+{
+	size_t num_options = 0;
+	bool error = false;
+	long long period;
+	char *token;
+
+	token = next_token(&line, &error);
+	if (!token) {
+		fprintf(stderr, "%s:%zu: unterminated quote\n", config_path,
+			lineno);
+		return -1;
+	}
+	if (!find_section(token)) {
+		fprintf(stderr, "%s:%zu: no section \"%s\"\n", config_path,
+			lineno, token);
+		return -1;
+	}
+	config->name = strdup(token);
+	if (!config->name) {
+		perror("strdup");
+		return -1;
+	}
+
+	while ((token = next_token(&line, &error))) {
+		char **options;
+
+		if (!strchr(token, '=')) {
+			fprintf(stderr, "%s:%zu: invalid option \"%s\"\n",
+				config_path, lineno, token);
+			return -1;
+		}
+		if (strncmp(token, "period=", 7) == 0) {
+			if (parse_int(token + 7, &period) || period <= 0 ||
+			    period > UINT_MAX) {
+				fprintf(stderr, "%s:%zu: invalid period\n",
+					config_path, lineno);
+				return -1;
+			}
+			config->period = period;
+			continue;
+		}
+
+		options = realloc(config->options,
+				  (num_options + 2) * sizeof(*options));
+		if (!options) {
+			perror("realloc");
+			return -1;
+		}
+		config->options = options;
+		options[num_options + 1] = NULL;
+		options[num_options] = strdup(token);
+		if (!options[num_options]) {
+			perror("strdup");
+			return -1;
+		}
+		num_options++;
+	}
+	if (error) {
+		fprintf(stderr, "%s:%zu: unterminated quote\n", config_path,
+			lineno);
+		return -1;
+	}
+	return 0;
+}
+
+static int load_config(FILE *file, struct section_config **sections_ret,
+		       size_t *count_ret)
+{
+	struct section_config *sections = NULL;
+	size_t count = 0, lineno = 0;
+	char *line = NULL, *p;
+	size_t n = 0;
+	int ret = -1;
+
+	while (getline(&line, &n, file) != -1) {
+		struct section_config *tmp;
+
+		lineno++;
+		p = line + strspn(line, " \t\n");
+		if (!*p || *p == '#')
+			continue;
+
+		tmp = realloc(sections, (count + 1) * sizeof(*sections));
+		if (!tmp) {
+			perror("realloc");
+			goto out;
+		}
+		sections = tmp;
+		memset(&sections[count], 0, sizeof(sections[count]));
+		count++;
+		if (parse_line(p, &sections[count - 1], lineno))
+			goto out;
+	}
+	if (ferror(file)) {
+		perror("getline");
+		goto out;
+	}
+
+	*sections_ret = sections;
+	*count_ret = count;
+	sections = NULL;
+	ret = 0;
+out:
+	if (sections)
+		free_section_configs(sections, count);
+	free(line);
+	return ret;
+}
+
+/* Use the default sections if there is no configuration file. */
+static int default_config(struct section_config **sections_ret,
+			  size_t *count_ret)
+{
+	size_t count = sizeof(default_sections) / sizeof(*default_sections);
+	struct section_config *sections;
+	size_t i;
+
+	sections = calloc(count, sizeof(*sections));
+	if (!sections) {
+		perror("calloc");
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		sections[i].name = strdup(default_sections[i]);
+		if (!sections[i].name) {
+			perror("strdup");
+			free_section_configs(sections, count);
+			return -1;
+		}
+	}
+	*sections_ret = sections;
+	*count_ret = count;
+	return 0;
+}
+
+/*
+ * Read the configuration file, or the default configuration if the file
+ * doesn't exist and optional is true.
+ */
+static int read_config(bool optional, struct section_config **sections,
+		       size_t *count)
+{
+	FILE *file;
+	int ret;
+
+	file = fopen(config_path, "re");
+	if (!file) {
+		if (errno == ENOENT && optional)
+			return default_config(sections, count);
+		perror(config_path);
+		return -1;
+	}
+	ret = load_config(file, sections, count);
+	fclose(file);
+	return ret;
+}
+
+static int reload_config(void)
+{
+	struct section_config *sections;
+	size_t count;
+	int ret;
+
+	if (read_config(true, &sections, &count)) {
+		fprintf(stderr, "keeping the current configuration\n");
+		return 0;
+	}
+	ret = reconfigure_sections(sections, count);
+	free_section_configs(sections, count);
+	return ret;
+}
+
+static int inotify_callback(int fd, void *data, uint32_t events)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	bool changed = false;
+	ssize_t sret;
+	char *p;
+
+	for (;;) {
+		sret = read(fd, buf, sizeof(buf));
+		if (sret == -1) {
+			if (errno == EAGAIN)
+				break;
+			perror("read(inotify)");
+			return -1;
+		}
+		for (p = buf; p < buf + sret;
+		     p += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)p;
+			if (event->len && strcmp(event->name, config_name) == 0)
+				changed = true;
+		}
+	}
+	if (!changed)
+		return 0;
+	return reload_config();
+}
+
+static int default_config_path(void)
+{
+	const char *dir;
+	int ret;
+
+	dir = getenv("XDG_CONFIG_HOME");
+	if (dir && *dir) {
+		ret = asprintf(&config_path, "%s/verbar/config", dir);
+	} else {
+		dir = getenv("HOME");
+		if (!dir) {
+			fprintf(stderr, "HOME is not set\n");
+			return -1;
+		}
+		ret = asprintf(&config_path, "%s/.config/verbar/config", dir);
+	}
+	if (ret == -1) {
+		config_path = NULL;
+		perror("asprintf");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Watch the directory containing the configuration file so that we notice
+ * editors which replace the file rather than writing to it. If the directory
+ * doesn't exist, there is nothing to watch.
+ */
+static int watch_config(int epoll_fd)
+{
+	struct epoll_event ev;
+	char *slash;
+
+	slash = strrchr(config_path, '/');
+	if (slash) {
+		config_dir = strndup(config_path, slash - config_path + 1);
+		config_name = slash + 1;
+	} else {
+		config_dir = strdup(".");
+		config_name = config_path;
+	}
+	if (!config_dir) {
+		perror("strdup");
+		return -1;
+	}
+
+	inotify_cb.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_cb.fd == -1) {
+		perror("inotify_init1");
+		return -1;
+	}
+	if (inotify_add_watch(inotify_cb.fd, config_dir,
+			      IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+		if (errno == ENOENT)
+			return 0;
+		perror("inotify_add_watch");
+		return -1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &inotify_cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_cb.fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	return 0;
+}
+
+int init_config(const char *path, int epoll_fd)
+{
+	struct section_config *sections;
+	size_t count;
+	int ret;
+
+	if (path) {
+		config_path = strdup(path);
+		if (!config_path) {
+			perror("strdup");
+			return -1;
+		}
+	} else if (default_config_path()) {
+		return -1;
+	}
+
+	if (watch_config(epoll_fd) ||
+	    read_config(!path, &sections, &count))
+		return -1;
+	ret = init_sections(epoll_fd, sections, count);
+	free_section_configs(sections, count);
+	return ret;
+}
+
+void free_config(void)
+{
+	if (inotify_cb.fd != -1) {
+		close(inotify_cb.fd);
+		inotify_cb.fd = -1;
+	}
+	free(config_dir);
+	config_dir = NULL;
+	free(config_path);
+	config_path = NULL;
+}
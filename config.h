@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/*
+ * Start the sections listed in the configuration file at the given path. If
+ * path is NULL, $XDG_CONFIG_HOME/verbar/config is used if it exists, or else a
+ * default list of sections.
+ *
+ * Each line of the file names a section followed by options of the form
+ * key=value, which may be quoted with double quotes. "period" sets the period
+ * of timer updates in milliseconds; other options are passed to the section.
+ * Empty lines and lines starting with # are ignored. For example:
+ *
+ * cpu period=1000
+ * # Show the time without seconds.
+ * clock format=" %a %b %d %H:%M"
+ *
+ * The file is watched for changes, which are applied without restarting
+ * sections which didn't change.
+ */
+int init_config(const char *path, int epoll_fd);
+void free_config(void);
+
+#endif /* CONFIG_H */
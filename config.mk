@@ -1,3 +1,22 @@
 PREFIX = /usr/local
-CFLAGS = -std=gnu99 -pedantic -Wall -Werror -D_GNU_SOURCE -O2 `pkg-config --cflags x11`
-LDFLAGS = -lmnl -lpulse `pkg-config --libs x11`
+CFLAGS = -std=gnu99 -pedantic -Wall -Werror -D_GNU_SOURCE -O2 -pthread `pkg-config --cflags $(X_PKGS)`
+LDFLAGS = -rdynamic -ldl `pkg-config --libs $(X_PKGS)`
+
+# Uncomment to leave out the x output, which is the only one that uses Xlib and
+# its extensions (and the only one that pauses updates while the screen is
+# blanked), so that only libxcb is linked. The default output is then xcb.
+#NO_XLIB = 1
+
+# Libraries used by the net and volume sections.
+MNL_LIBS = -lmnl
+PULSE_LIBS = -lpulse
+
+# Sections to build as plugins instead of linking them into verbar, and where
+# to install and look for them. For example, with "net volume" here, verbar
+# only maps libmnl and libpulse if the configuration uses those sections.
+PLUGIN_SECTIONS =
+PLUGINDIR = $(PREFIX)/lib/verbar
+
+# USDT probes (see probes.h) are compiled in if sys/sdt.h is installed (e.g.,
+# from systemtap-sdt-dev). Uncomment to leave them out anyway.
+#CFLAGS += -DNO_PROBES
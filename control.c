@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "control.h"
+#include "verbar_internal.h"
+
+/* Maximum length of a command line. */
+#define MAX_LINE 256
+
+struct client {
+	struct epoll_callback epoll;
+	char buf[MAX_LINE];
+	size_t len;
+	struct client *next;
+};
+
+static int listen_callback(int fd, void *data, uint32_t events);
+
+static struct epoll_callback listen_cb = {
+	.callback = listen_callback,
+	.fd = -1,
+	.name = "control listen",
+};
+
+static const char *socket_path;
+static int control_epoll_fd = -1;
+static struct client *clients;
+
+static void close_client(struct client *client)
+{
+	struct client **p;
+
+	for (p = &clients; *p; p = &(*p)->next) {
+		if (*p == client) {
+			*p = client->next;
+			break;
+		}
+	}
+	/* Closing the file descriptor also removes it from epoll. */
+	close(client->epoll.fd);
+	free(client);
+}
+
+static int run_command(char *line, struct str *reply)
+{
+	char *saveptr, *cmd, *name, *arg;
+	long long period;
+	int ret;
+
+	cmd = strtok_r(line, " \t", &saveptr);
+	name = cmd ? strtok_r(NULL, " \t", &saveptr) : NULL;
+	arg = name ? strtok_r(NULL, " \t", &saveptr) : NULL;
+
+	if (!cmd) {
+		return str_append(reply, "error: empty command\n");
+	} else if (strcmp(cmd, "refresh") == 0 && !name) {
+		reset_timer_sections();
+		dirty_sections();
+		request_update();
+		ret = 1;
+	} else if ((strcmp(cmd, "enable") == 0 ||
+		    strcmp(cmd, "disable") == 0) && name && !arg) {
+		ret = enable_section(name, cmd[0] == 'e');
+	} else if (strcmp(cmd, "period") == 0 && arg) {
+		if (parse_int(arg, &period) || period <= 0 ||
+		    period > UINT32_MAX)
+			return str_appendf(reply, "error: invalid period \"%s\"\n",
+					   arg);
+		ret = set_section_period(name, period);
+	} else if (strcmp(cmd, "get") == 0 && !arg) {
+		ret = query_sections(reply, name);
+		/* There being no sections at all isn't an error. */
+		if (!ret && !name)
+			ret = 1;
+	} else {
+		return str_append(reply, "error: invalid command\n");
+	}
+
+	if (ret < 0)
+		return -1;
+	if (!ret)
+		return str_appendf(reply, "error: no section \"%s\"\n", name);
+	return str_append(reply, "ok\n");
+}
+
+static int client_callback(int fd, void *data, uint32_t events)
+{
+	struct client *client = data;
+	struct str reply;
+	char *line, *end;
+	ssize_t sret;
+	int ret = 0;
+
+	memset(&reply, 0, sizeof(reply));
+
+	sret = read(fd, client->buf + client->len,
+		    sizeof(client->buf) - client->len);
+	if (sret == -1) {
+		if (errno == EAGAIN)
+			return 0;
+		perror("read(control)");
+		close_client(client);
+		return 0;
+	}
+	if (sret == 0) {
+		close_client(client);
+		return 0;
+	}
+	client->len += sret;
+
+	line = client->buf;
+	while ((end = memchr(line, '\n', client->buf + client->len - line))) {
+		*end = '\0';
+		ret = run_command(line, &reply);
+		if (ret)
+			goto out;
+		line = end + 1;
+	}
+	client->len -= line - client->buf;
+	memmove(client->buf, line, client->len);
+	if (client->len == sizeof(client->buf)) {
+		ret = str_append(&reply, "error: line too long\n");
+		client->len = 0;
+		if (ret)
+			goto out;
+	}
+
+	/*
+	 * Don't let a client that isn't reading its replies block the status
+	 * bar; drop it instead.
+	 */
+	if (reply.len) {
+		sret = send(fd, reply.buf, reply.len,
+			    MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sret != reply.len)
+			close_client(client);
+	}
+out:
+	str_free(&reply);
+	return ret;
+}
+
+static int listen_callback(int fd, void *data, uint32_t events)
+{
+	struct client *client;
+	struct epoll_event ev;
+	int client_fd;
+
+	client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (client_fd == -1) {
+		if (errno == EAGAIN || errno == ECONNABORTED)
+			return 0;
+		perror("accept4");
+		return -1;
+	}
+
+	client = calloc(1, sizeof(*client));
+	if (!client) {
+		perror("calloc");
+		close(client_fd);
+		return -1;
+	}
+	client->epoll.callback = client_callback;
+	client->epoll.fd = client_fd;
+	client->epoll.data = client;
+	client->epoll.name = "control client";
+	client->next = clients;
+	clients = client;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &client->epoll;
+	if (epoll_ctl(control_epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) == -1) {
+		perror("epoll_ctl");
+		close_client(client);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Remove a socket left behind by a verbar that didn't exit cleanly, but not one
+ * that something is still listening on.
+ */
+static int remove_stale_socket(const struct sockaddr_un *addr)
+{
+	struct stat st;
+	int fd, ret, err;
+
+	if (lstat(addr->sun_path, &st) == -1 || !S_ISSOCK(st.st_mode)) {
+		fprintf(stderr, "%s exists and is not a socket\n",
+			addr->sun_path);
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+	ret = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	err = errno;
+	close(fd);
+	if (ret == 0) {
+		fprintf(stderr, "control socket %s is in use\n",
+			addr->sun_path);
+		return -1;
+	} else if (err != ECONNREFUSED) {
+		errno = err;
+		perror("connect(control)");
+		return -1;
+	}
+	if (unlink(addr->sun_path) == -1) {
+		perror("unlink(control)");
+		return -1;
+	}
+	return 0;
+}
+
+int init_control(const char *path, int epoll_fd)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	struct epoll_event ev;
+	int ret;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "path to control socket is too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	listen_cb.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+			      SOCK_CLOEXEC, 0);
+	if (listen_cb.fd == -1) {
+		perror("socket");
+		return -1;
+	}
+	ret = bind(listen_cb.fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (ret == -1 && errno == EADDRINUSE) {
+		if (remove_stale_socket(&addr))
+			return -1;
+		ret = bind(listen_cb.fd, (struct sockaddr *)&addr,
+			   sizeof(addr));
+	}
+	if (ret == -1) {
+		perror("bind(control)");
+		return -1;
+	}
+	socket_path = path;
+	if (listen(listen_cb.fd, 4) == -1) {
+		perror("listen");
+		return -1;
+	}
+
+	control_epoll_fd = epoll_fd;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listen_cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_cb.fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	return 0;
+}
+
+void free_control(void)
+{
+	while (clients)
+		close_client(clients);
+	if (listen_cb.fd != -1) {
+		close(listen_cb.fd);
+		listen_cb.fd = -1;
+	}
+	if (socket_path) {
+		unlink(socket_path);
+		socket_path = NULL;
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+/*
+ * Serve the control socket at the given path. Clients send one command per
+ * line:
+ *
+ * refresh               update and redraw every section
+ * enable NAME           show and update a section again
+ * disable NAME          hide a section and stop updating it
+ * period NAME MS        update a section every MS milliseconds
+ * get [NAME]            print the state of a section or of every section
+ *
+ * Each command is answered with any output followed by "ok" or by an "error:"
+ * line.
+ */
+int init_control(const char *path, int epoll_fd);
+void free_control(void);
+
+#endif /* CONTROL_H */
@@ -28,13 +28,14 @@ struct cpu_section {
 	double cpu_usage;
 
 	long long prev_active, prev_idle;
+	char *path;
 	char *buf;
 	size_t n;
 };
 
 static void cpu_free(void *data);
 
-static void *cpu_init(int epoll_fd)
+static void *cpu_init(int epoll_fd, char * const *options)
 {
 	struct cpu_section *section;
 
@@ -43,12 +44,19 @@ static void *cpu_init(int epoll_fd)
 		perror("malloc");
 		return NULL;
 	}
+	section->cpu_usage = 0.0;
 	section->prev_active = 0;
 	section->prev_idle = 0;
 	section->n = 4096;
 	section->buf = malloc(section->n);
 	if (!section->buf) {
 		perror("malloc");
+		section->path = NULL;
+		cpu_free(section);
+		return NULL;
+	}
+	section->path = host_path("/proc/stat");
+	if (!section->path) {
 		cpu_free(section);
 		return NULL;
 	}
@@ -58,6 +66,7 @@ static void *cpu_init(int epoll_fd)
 static void cpu_free(void *data)
 {
 	struct cpu_section *section = data;
+	free(section->path);
 	free(section->buf);
 	free(section);
 }
@@ -65,14 +74,14 @@ static void cpu_free(void *data)
 static int cpu_update(void *data)
 {
 	struct cpu_section *section = data;
+	double cpu_usage;
 	FILE *file;
 	int status;
 
-	file = fopen("/proc/stat", "rb");
+	file = fopen(section->path, "rb");
 	if (!file) {
 		if (errno == ENOENT) {
-			fprintf(stderr, "/proc/stat does not exist\n");
-			return 0;
+			return SECTION_UNAVAILABLE;
 		} else {
 			perror("fopen(\"/proc/stat\")");
 			return -1;
@@ -95,13 +104,14 @@ static int cpu_update(void *data)
 		section->prev_idle = idle;
 
 		if (interval_total > 0) {
-			section->cpu_usage = 100.0 * ((double)interval_active /
-						      (double)interval_total);
+			cpu_usage = 100.0 * ((double)interval_active /
+					     (double)interval_total);
 		} else {
-			section->cpu_usage = 0.0;
+			cpu_usage = 0.0;
 		}
 
-		status = 0;
+		status = cpu_usage != section->cpu_usage;
+		section->cpu_usage = cpu_usage;
 		goto out;
 	}
 	if (ferror(file)) {
@@ -111,7 +121,7 @@ static int cpu_update(void *data)
 	}
 
 	fprintf(stderr, "Missing cpu in /proc/stat\n");
-	status = 0;
+	status = -1;
 out:
 	fclose(file);
 	return status;
@@ -127,11 +137,25 @@ static int cpu_append(void *data, struct str *str, bool wordy)
 	return str_separator(str);
 }
 
+static size_t cpu_values(void *data, struct section_value *values,
+			 size_t max)
+{
+	struct cpu_section *section = data;
+
+	if (max < 1)
+		return 0;
+	values[0].key = "usage";
+	values[0].value = section->cpu_usage;
+	return 1;
+}
+
 static const struct section cpu_section = {
 	.name = "cpu",
 	.init = cpu_init,
 	.free = cpu_free,
 	.timer_update = cpu_update,
+	.period = 2000,
 	.append = cpu_append,
+	.values = cpu_values,
 };
 register_section(cpu_section);
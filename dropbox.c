@@ -15,34 +15,74 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/un.h>
 
 #include "verbar.h"
 
+static const char *command = "get_dropbox_status\ndone\n";
+
 struct dropbox_section {
 	bool running;
 	bool uptodate;
+	/* Is the busy icon shown for this blink? */
+	bool busy;
 	char *status;
 
+	/*
+	 * Blinks the busy icon every second while syncing. This only
+	 * re-renders the cached status; the daemon is still only queried once
+	 * per period.
+	 */
+	struct epoll_callback blink;
+	bool blinking;
+
+	/* Status query in progress on the command socket. */
+	struct epoll_callback epoll;
+	size_t sent;
 	char *buf;
-	size_t n;
+	size_t len, n;
 };
 
 static void dropbox_free(void *data);
 
-static void *dropbox_init(int epoll_fd)
+static int dropbox_epoll_callback(int fd, void *data, uint32_t events);
+static int dropbox_blink_callback(int fd, void *data, uint32_t events);
+
+static void *dropbox_init(int epoll_fd, char * const *options)
 {
 	struct dropbox_section *section;
 
-	section = malloc(sizeof(*section));
+	section = calloc(1, sizeof(*section));
 	if (!section) {
-		perror("malloc");
+		perror("calloc");
+		return NULL;
+	}
+	section->epoll.callback = dropbox_epoll_callback;
+	section->epoll.fd = -1;
+	section->epoll.data = section;
+	section->epoll.name = "dropbox";
+	section->blink.callback = dropbox_blink_callback;
+	section->blink.data = section;
+	section->blink.name = "dropbox-blink";
+	section->blink.fd = timerfd_create(CLOCK_MONOTONIC,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+	if (section->blink.fd == -1) {
+		perror("timerfd_create");
+		free(section);
+		return NULL;
+	}
+	if (watch_fd(&section->blink, EPOLLIN)) {
+		close(section->blink.fd);
+		free(section);
 		return NULL;
 	}
 	section->n = 128;
@@ -55,19 +95,33 @@ static void *dropbox_init(int epoll_fd)
 	return section;
 }
 
+static void dropbox_cancel(void *data)
+{
+	struct dropbox_section *section = data;
+
+	if (section->epoll.fd != -1) {
+		unwatch_fd(&section->epoll);
+		close(section->epoll.fd);
+		section->epoll.fd = -1;
+	}
+}
+
 static void dropbox_free(void *data)
 {
 	struct dropbox_section *section = data;
+	dropbox_cancel(section);
+	unwatch_fd(&section->blink);
+	close(section->blink.fd);
+	free(section->status);
 	free(section->buf);
 	free(section);
 }
 
-static FILE *connect_to_dropboxd(void)
+static int connect_to_dropboxd(void)
 {
 	struct sockaddr_un addr = {
 		.sun_family = AF_UNIX,
 	};
-	FILE *sock;
 	char *home;
 	int sockfd;
 	int ret;
@@ -75,129 +129,251 @@ static FILE *connect_to_dropboxd(void)
 	home = getenv("HOME");
 	if (!home) {
 		fprintf(stderr, "HOME is not set\n");
-		return NULL;
+		return -1;
 	}
 
 	ret = snprintf(addr.sun_path, sizeof(addr.sun_path),
 		       "%s/.dropbox/command_socket", home);
 	if (ret >= sizeof(addr.sun_path)) {
 		fprintf(stderr, "path to command socket is too long\n");
-		return NULL;
+		return -1;
 	}
 
-	sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			0);
 	if (sockfd == -1) {
 		perror("socket");
-		return NULL;
+		return -1;
 	}
 
 	ret = connect(sockfd, &addr, sizeof(addr));
-	if (ret == -1) {
+	if (ret == -1 && errno != EAGAIN && errno != EINPROGRESS) {
 		close(sockfd);
-		return NULL;
+		return -1;
 	}
 
-	sock = fdopen(sockfd, "rb");
-	if (!sock) {
-		perror("fdopen");
-		close(sockfd);
-		return NULL;
+	return sockfd;
+}
+
+/*
+ * Parse the response to the command. Returns 1 and sets status and uptodate if
+ * the response is complete, 0 if more is needed, or -1 on error.
+ */
+static int parse_status(struct dropbox_section *section, char **status,
+			bool *uptodate)
+{
+	char *line, *end;
+
+	if (section->len < 3)
+		return 0;
+	if (memcmp(section->buf, "ok\n", 3) != 0) {
+		fprintf(stderr, "dropbox command error\n");
+		return -1;
 	}
 
-	return sock;
+	line = section->buf + 3;
+	while ((end = memchr(line, '\n', section->buf + section->len - line))) {
+		*end = '\0';
+		if (strncmp(line, "status\t", 7) == 0) {
+			*status = line + 7;
+			*strchrnul(*status, '\t') = '\0';
+			*uptodate = strcmp(*status, "Up to date") == 0;
+			return 1;
+		} else if (strcmp(line, "done") == 0) {
+			*status = strcpy(line, "Idle");
+			*uptodate = true;
+			return 1;
+		}
+		line = end + 1;
+	}
+	return 0;
 }
 
-static int sendall(int fd, const void *buf, size_t len)
+/*
+ * Start or stop blinking the busy icon. Blinking starts on the busy icon.
+ */
+static int set_blinking(struct dropbox_section *section, bool blinking)
 {
-	const char *p = buf;
-	ssize_t sret;
+	struct itimerspec it = {{0}};
 
-	while (len > 0) {
-		sret = write(fd, p, len);
-		if (sret == -1)
-			return -1;
-		p += sret;
-		len -= sret;
+	if (blinking == section->blinking)
+		return 0;
+	if (blinking) {
+		it.it_value.tv_sec = 1;
+		it.it_interval.tv_sec = 1;
+	}
+	if (timerfd_settime(section->blink.fd, 0, &it, NULL) == -1) {
+		perror("timerfd_settime");
+		return -1;
 	}
+	section->blinking = blinking;
+	section->busy = blinking;
 	return 0;
 }
 
-static int read_status(struct dropbox_section *section, FILE *sock)
+static int dropbox_blink_callback(int fd, void *data, uint32_t events)
 {
-	char ok[3];
+	struct dropbox_section *section = data;
+	uint64_t expirations;
 
-	if (fread(ok, 1, 3, sock) != 3 || memcmp(ok, "ok\n", 3) != 0) {
-		fprintf(stderr, "dropbox command error\n");
+	if (read(fd, &expirations, sizeof(expirations)) == -1) {
+		if (errno == EAGAIN)
+			return 0;
+		perror("read(timerfd)");
 		return -1;
 	}
+	if (section->blinking) {
+		section->busy = !section->busy;
+		section_dirty(section);
+	}
+	return 0;
+}
+
+/*
+ * Finish a status query with an error.
+ */
+static int fail_query(struct dropbox_section *section)
+{
+	dropbox_cancel(section);
+	section->running = false;
+	set_blinking(section, false);
+	return section_update_done(section, -1);
+}
+
+/*
+ * Finish a status query. status is NULL if Dropbox isn't running.
+ */
+static int finish_query(struct dropbox_section *section, const char *status,
+			bool uptodate)
+{
+	bool running = status != NULL;
+	int changed;
+
+	dropbox_cancel(section);
+
+	changed = running != section->running;
+	section->running = running;
+	if (!running) {
+		if (set_blinking(section, false))
+			return section_update_done(section, -1);
+		return section_update_done(section, SECTION_UNAVAILABLE);
+	}
 
-	while (getline(&section->buf, &section->n, sock) != -1) {
-		if (strncmp(section->buf, "status\t", 7) == 0) {
-			section->status = section->buf + 7;
-			*strchrnul(section->status, '\n') = '\0';
-			*strchrnul(section->status, '\t') = '\0';
-			section->uptodate = strcmp(section->status, "Up to date") == 0;
-			return 0;
-		} else if (strcmp(section->buf, "done\n") == 0) {
-			section->status = strcpy(section->buf, "Idle");
-			section->uptodate = true;
-			return 0;
+	if (uptodate != section->uptodate) {
+		section->uptodate = uptodate;
+		changed = 1;
+	}
+	if (!section->status || strcmp(section->status, status) != 0) {
+		free(section->status);
+		section->status = strdup(status);
+		if (!section->status) {
+			perror("strdup");
+			section->running = false;
+			set_blinking(section, false);
+			return section_update_done(section, -1);
 		}
+		changed = 1;
+	}
+
+	if (section->blinking != !uptodate) {
+		if (set_blinking(section, !uptodate))
+			return section_update_done(section, -1);
+		changed = 1;
 	}
-	if (ferror(sock))
-		perror("getline(\"~/.dropbox/command_socket\")");
-	return -1;
+
+	return section_update_done(section, changed);
 }
 
-static int dropbox_update(void *data)
+static int dropbox_epoll_callback(int fd, void *data, uint32_t events)
 {
-	static const char *command = "get_dropbox_status\ndone\n";
 	struct dropbox_section *section = data;
-	FILE *sock;
+	size_t len = strlen(command);
+	bool uptodate = false;
+	char *status;
+	ssize_t sret;
 	int ret;
 
-	section->running = false;
+	/* The query may have been canceled earlier in this batch of events. */
+	if (fd == -1)
+		return 0;
 
-	sock = connect_to_dropboxd();
-	if (!sock)
+	if (section->sent < len) {
+		sret = write(fd, command + section->sent, len - section->sent);
+		if (sret == -1) {
+			if (errno == EAGAIN)
+				return 0;
+			/* The connection failed, so Dropbox isn't running. */
+			return finish_query(section, NULL, false);
+		}
+		section->sent += sret;
+		if (section->sent == len)
+			return watch_fd(&section->epoll, EPOLLIN);
 		return 0;
+	}
+
+	if (section->len + 1 >= section->n) {
+		char *buf;
 
-	ret = sendall(fileno(sock), command, strlen(command));
-	if (ret == -1) {
-		perror("send(\"~/.dropbox/command_socket\")");
-		goto out;
+		buf = realloc(section->buf, 2 * section->n);
+		if (!buf) {
+			perror("realloc");
+			return fail_query(section);
+		}
+		section->buf = buf;
+		section->n *= 2;
+	}
+	sret = read(fd, section->buf + section->len,
+		    section->n - section->len - 1);
+	if (sret == -1) {
+		if (errno == EAGAIN)
+			return 0;
+		perror("read(\"~/.dropbox/command_socket\")");
+		return fail_query(section);
 	}
+	if (sret == 0) {
+		fprintf(stderr, "dropbox command error\n");
+		return fail_query(section);
+	}
+	section->len += sret;
 
-	ret = read_status(section, sock);
-	if (ret == -1)
-		goto out;
+	ret = parse_status(section, &status, &uptodate);
+	if (ret == 0)
+		return 0;
+	if (ret < 0)
+		return fail_query(section);
+	return finish_query(section, status, uptodate);
+}
 
-	section->running = true;
-out:
-	shutdown(fileno(sock), SHUT_RDWR);
-	fclose(sock);
+static int dropbox_start(void *data)
+{
+	struct dropbox_section *section = data;
+
+	section->sent = 0;
+	section->len = 0;
+	section->epoll.fd = connect_to_dropboxd();
+	if (section->epoll.fd == -1)
+		return finish_query(section, NULL, false);
+
+	/* Wait for the connection to be established. */
+	if (watch_fd(&section->epoll, EPOLLOUT)) {
+		dropbox_cancel(section);
+		return -1;
+	}
 	return 0;
 }
 
 static int dropbox_append(void *data, struct str *str, bool wordy)
 {
 	struct dropbox_section *section = data;
-	struct timespec tp;
 	int ret;
 
 	if (!section->running)
 		return 0;
 
-	ret = clock_gettime(CLOCK_MONOTONIC, &tp);
-	if (ret) {
-		perror("clock_gettime");
-		return -1;
-	}
-
-	if (section->uptodate || tp.tv_sec % 2)
-		ret = str_append_icon(str, "dropbox_idle");
-	else
+	if (section->busy)
 		ret = str_append_icon(str, "dropbox_busy");
+	else
+		ret = str_append_icon(str, "dropbox_idle");
 	if (ret)
 	    return -1;
 
@@ -216,7 +392,10 @@ static const struct section dropbox_section = {
 	.name = "dropbox",
 	.init = dropbox_init,
 	.free = dropbox_free,
-	.timer_update = dropbox_update,
+	.start_update = dropbox_start,
+	.cancel_update = dropbox_cancel,
+	.timeout = 2000,
+	.period = 5000,
 	.append = dropbox_append,
 };
 register_section(dropbox_section);
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -28,51 +29,291 @@
 #include <sys/signalfd.h>
 #include <sys/timerfd.h>
 #include <sys/types.h>
-#include <X11/Xlib.h>
 
+#include "config.h"
+#include "control.h"
+#include "probes.h"
+#include "profile.h"
+#include "output.h"
+#include "snapshot.h"
+#include "trace.h"
 #include "verbar_internal.h"
 
 static const char *progname = "verbar";
 
 extern char **environ;
 
-static Display *dpy;
-static Window root;
-
-static const char *config[] = {
-	"dropbox",
-	"net",
-	"volume",
-	"cpu",
-	"mem",
-	"power",
-	"clock",
+/*
+ * Somewhere the status bar is shown, with its own sections and verbosity.
+ * However many sinks there are, sections are only updated once per tick and
+ * rendered once per change.
+ */
+struct sink {
+	struct output *output;
+
+	/* Show the opposite of the global wordy setting. */
+	bool wordy;
+
+	/*
+	 * NULL-terminated names of the sections to show, or NULL for all. The
+	 * names are all in the buffer starting at sections[0].
+	 */
+	char **sections;
+
+	/* The status being built and the last status that was shown. */
+	struct str status_str, prev_status_str;
 };
 
+static struct sink *sinks;
+static size_t num_sinks;
+
 static bool quit, update, wordy;
 
-static struct str status_str;
+/* Time spent in suspend as of the last timer update. */
+static uint64_t suspend_time;
+
+/* Deadline that the timerfd is armed for, or UINT64_MAX if it is disarmed. */
+static uint64_t armed_deadline = UINT64_MAX;
+
+/*
+ * Maximum number of status bar updates per second, or zero for no limit, and
+ * the time of the last update.
+ */
+static unsigned int max_rate = 20;
+static uint64_t last_render;
+static bool render_deferred;
+
+/* Where to attribute the cost of rendering for --profile. */
+static struct profile_entry *format_profile, *flush_profile;
 
 void request_update(void)
 {
 	update = true;
 }
 
+static uint64_t monotonic_now(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return timespec_to_ns(&tp);
+}
+
+/* Returns 1 if the sink was updated, 0 if it didn't change, or -1 on error. */
+static int render_sink(struct sink *sink)
+{
+	bool sink_wordy = wordy != sink->wordy;
+	const struct block *blocks;
+	struct profile_sample sample;
+	size_t num_blocks;
+	struct str tmp;
+	int ret;
+
+	if (profiling)
+		profile_start(&sample);
+	ret = format_statusbar(&sink->status_str, &sink->prev_status_str,
+			       sink_wordy, sink->sections);
+	if (profiling)
+		profile_end(format_profile, &sample);
+	if (ret <= 0)
+		return ret;
+	if (get_blocks(&blocks, &num_blocks, sink_wordy, sink->sections))
+		return -1;
+
+	PROBE1(render__start, sink->status_str.len);
+	if (profiling)
+		profile_start(&sample);
+	ret = render_output(sink->output, &sink->status_str, blocks,
+			    num_blocks);
+	if (profiling)
+		profile_end(flush_profile, &sample);
+	PROBE(render__end);
+	if (ret)
+		return ret;
+
+	if (startup_report && sink == sinks && !sink->prev_status_str.len) {
+		fprintf(stderr, "startup: first frame after %.3f ms\n",
+			startup_elapsed() / 1e6);
+	}
+
+	tmp = sink->prev_status_str;
+	sink->prev_status_str = sink->status_str;
+	sink->status_str = tmp;
+
+	return 1;
+}
+
 static int update_statusbar(void)
 {
-	status_str.len = 0;
+	bool rendered = false;
+	uint64_t start;
+	size_t i;
+	int ret;
+
+	start = monotonic_now();
+	for (i = 0; i < num_sinks; i++) {
+		ret = render_sink(&sinks[i]);
+		if (ret < 0)
+			return ret;
+		if (ret)
+			rendered = true;
+	}
+	/* Values can change even if the text didn't. */
+	publish_snapshot();
+	if (!rendered)
+		return 0;
+	histogram_add(&self_stats.render, monotonic_now() - start);
+	if (tracing)
+		trace_event("render", "render", start);
+	return 0;
+}
+
+/* Parse "OUTPUT [wordy] [sections=NAME,...]" and open the output. */
+static int open_sink(struct sink *sink, const char *spec, int epoll_fd)
+{
+	char *copy, *saveptr, *output_spec, *token;
+	size_t n;
+	int ret = -1;
+
+	copy = strdup(spec);
+	if (!copy) {
+		perror("strdup");
+		return -1;
+	}
+	output_spec = strtok_r(copy, " ", &saveptr);
+	if (!output_spec) {
+		fprintf(stderr, "empty output\n");
+		goto out;
+	}
+	while ((token = strtok_r(NULL, " ", &saveptr))) {
+		if (strcmp(token, "wordy") == 0) {
+			sink->wordy = true;
+		} else if (strncmp(token, "sections=", 9) == 0 &&
+			   !sink->sections) {
+			char *names, *p;
+
+			names = strdup(token + 9);
+			if (!names) {
+				perror("strdup");
+				goto out;
+			}
+			for (n = 1, p = names; *p; p++)
+				n += *p == ',';
+			sink->sections = calloc(n + 1,
+						sizeof(*sink->sections));
+			if (!sink->sections) {
+				perror("calloc");
+				free(names);
+				goto out;
+			}
+			sink->sections[0] = names;
+			for (n = 1, p = names; *p; p++) {
+				if (*p == ',') {
+					*p = '\0';
+					sink->sections[n++] = p + 1;
+				}
+			}
+		} else {
+			fprintf(stderr, "invalid output option \"%s\"\n",
+				token);
+			goto out;
+		}
+	}
+	sink->output = open_output(output_spec, epoll_fd);
+	if (sink->output)
+		ret = 0;
+out:
+	free(copy);
+	return ret;
+}
+
+static void close_sink(struct sink *sink)
+{
+	close_output(sink->output);
+	if (sink->sections) {
+		free(sink->sections[0]);
+		free(sink->sections);
+	}
+	str_free(&sink->status_str);
+	str_free(&sink->prev_status_str);
+}
+
+static int render_timer_callback(int fd, void *data, uint32_t events)
+{
+	uint64_t times;
+	ssize_t ssret;
 
-	if (str_append(&status_str, " "))
+	ssret = read(fd, &times, sizeof(times));
+	if (ssret == -1) {
+		perror("read(timerfd)");
 		return -1;
+	}
+	assert(ssret == sizeof(times));
+	render_deferred = false;
+	update = true;
+	return 0;
+}
 
-	append_sections(&status_str, wordy);
+static struct epoll_callback render_timer_cb = {
+	.callback = render_timer_callback,
+	.fd = -1,
+	.name = "render timer",
+};
 
-	if (str_null_terminate(&status_str))
+static int render_timer_init(int epoll_fd)
+{
+	struct epoll_event ev;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd == -1) {
+		perror("timerfd_create");
 		return -1;
+	}
+
+	render_timer_cb.fd = fd;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &render_timer_cb;
+
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/*
+ * Update the status bar now if we haven't done so recently, otherwise defer
+ * the update until the render timer fires so that bursts of updates are
+ * merged into one.
+ */
+static int render(void)
+{
+	struct itimerspec it;
+	struct timespec tp;
+	uint64_t now, interval;
 
-	XStoreName(dpy, root, status_str.buf);
-	XFlush(dpy);
+	if (!max_rate)
+		return update_statusbar();
+
+	if (render_deferred)
+		return 0;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp) == -1) {
+		perror("clock_gettime");
+		return -1;
+	}
+	now = timespec_to_ns(&tp);
+	interval = NSEC_PER_SEC / max_rate;
+	if (now - last_render >= interval) {
+		last_render = now;
+		return update_statusbar();
+	}
 
+	memset(&it, 0, sizeof(it));
+	it.it_value = ns_to_timespec(last_render + interval);
+	if (timerfd_settime(render_timer_cb.fd, TFD_TIMER_ABSTIME, &it,
+			    NULL) == -1) {
+		perror("timerfd_settime");
+		return -1;
+	}
+	render_deferred = true;
 	return 0;
 }
 
@@ -89,7 +330,10 @@ static int signal_fd_callback(int fd, void *data, uint32_t events)
 	assert(ssret == sizeof(ssi));
 	if (ssi.ssi_signo == SIGUSR1) {
 		wordy = !wordy;
+		dirty_sections();
 		update = true;
+	} else if (ssi.ssi_signo == SIGUSR2) {
+		print_self_stats(stderr);
 	} else {
 		fprintf(stderr, "got signal %s; exiting\n",
 			strsignal(ssi.ssi_signo));
@@ -101,6 +345,7 @@ static int signal_fd_callback(int fd, void *data, uint32_t events)
 static struct epoll_callback signal_cb = {
 	.callback = signal_fd_callback,
 	.fd = -1,
+	.name = "signalfd",
 };
 
 static int signal_fd_init(int epoll_fd)
@@ -115,6 +360,7 @@ static int signal_fd_init(int epoll_fd)
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
 	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
 	ret = sigprocmask(SIG_BLOCK, &mask, NULL);
 	if (ret == -1) {
 		perror("sigprocmask");
@@ -134,33 +380,137 @@ static int signal_fd_init(int epoll_fd)
 	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
 }
 
-static int timer_fd_callback(int fd, void *data, uint32_t events)
+/*
+ * On the virtual clock (see bench/soak.c), skip straight to the next deadline
+ * instead of sleeping until it. This waits for the worker threads to go idle
+ * first so that their updates take no virtual time. Returns the deadline to arm
+ * the timer for.
+ */
+static uint64_t skip_to_deadline(uint64_t deadline)
 {
+	struct timespec tp;
+	uint64_t now;
+
+	if (deadline == UINT64_MAX || outstanding_work())
+		return UINT64_MAX;
+	if (verbar_clock_gettime(timer_clockid(), &tp) == 0) {
+		now = timespec_to_ns(&tp);
+		if (deadline > now)
+			advance_virtual_clock(deadline - now);
+	}
+	return 0;
+}
 
-	uint64_t times;
-	ssize_t ssret;
-	int ret;
+static int arm_timer_fd(int fd)
+{
+	struct itimerspec it;
+	uint64_t deadline;
+	int flags;
+
+	deadline = next_timer_deadline();
+	if (virtual_clock_enabled())
+		deadline = skip_to_deadline(deadline);
+	if (deadline == armed_deadline)
+		return 0;
+
+	memset(&it, 0, sizeof(it));
+	if (deadline != UINT64_MAX) {
+		/*
+		 * A deadline in the past fires immediately, but zero would
+		 * disarm the timer instead.
+		 */
+		it.it_value = ns_to_timespec(deadline ? deadline : 1);
+	}
+	flags = TFD_TIMER_ABSTIME;
+	if (align_timers)
+		flags |= TFD_TIMER_CANCEL_ON_SET;
+	if (timerfd_settime(fd, flags, &it, NULL) == -1) {
+		perror("timerfd_settime");
+		return -1;
+	}
+	armed_deadline = deadline;
+	return 0;
+}
 
-	ssret = read(fd, &times, sizeof(times));
-	if (ssret == -1) {
-		perror("read(timerfd)");
+static int timer_now(uint64_t *now, bool *resumed)
+{
+	struct timespec ts, monotonic, boottime;
+	uint64_t suspended;
+
+	if (verbar_clock_gettime(timer_clockid(), &ts) == -1 ||
+	    verbar_clock_gettime(CLOCK_MONOTONIC, &monotonic) == -1 ||
+	    verbar_clock_gettime(CLOCK_BOOTTIME, &boottime) == -1) {
+		perror("clock_gettime");
 		return -1;
 	}
-	assert(ssret == sizeof(times));
-	if (times > 1) {
-		fprintf(stderr, "warning: missed %" PRIu64 " ticks\n",
-			times - 1);
+	*now = timespec_to_ns(&ts);
+
+	/*
+	 * CLOCK_MONOTONIC doesn't advance while suspended but CLOCK_BOOTTIME
+	 * does. Allow some slop for the time between the two calls.
+	 */
+	suspended = timespec_to_ns(&boottime) - timespec_to_ns(&monotonic);
+	*resumed = suspended > suspend_time + NSEC_PER_SEC / 10;
+	suspend_time = suspended;
+	return 0;
+}
+
+static int run_timers(bool clock_jumped)
+{
+	uint64_t now;
+	bool resumed;
+	int ret;
+
+	if (timer_now(&now, &resumed))
+		return -1;
+	if (clock_jumped || resumed) {
+		reset_timer_sections();
+		dirty_sections();
+		update = true;
 	}
-	ret = update_timer_sections();
-	if (ret)
+	ret = update_timer_sections(now);
+	if (ret < 0)
 		return -1;
-	update = true;
+	if (ret > 0)
+		update = true;
 	return 0;
 }
 
+static int timer_fd_callback(int fd, void *data, uint32_t events)
+{
+	bool clock_jumped = false;
+	uint64_t times, start;
+	ssize_t ssret;
+	int ret;
+
+	/* The timer is disarmed once it expires or is canceled. */
+	armed_deadline = UINT64_MAX;
+
+	ssret = read(fd, &times, sizeof(times));
+	if (ssret == -1) {
+		/* The realtime clock was set. */
+		if (errno != ECANCELED) {
+			perror("read(timerfd)");
+			return -1;
+		}
+		clock_jumped = true;
+	} else {
+		assert(ssret == sizeof(times));
+	}
+
+	PROBE(tick__start);
+	start = tracing ? trace_now() : 0;
+	ret = run_timers(clock_jumped);
+	if (tracing)
+		trace_event("tick", "tick", start);
+	PROBE1(tick__end, ret);
+	return ret;
+}
+
 static struct epoll_callback timer_cb = {
 	.callback = timer_fd_callback,
 	.fd = -1,
+	.name = "timerfd",
 };
 
 static int timer_fd_init(int epoll_fd)
@@ -168,7 +518,7 @@ static int timer_fd_init(int epoll_fd)
 	struct epoll_event ev;
 	int fd;
 
-	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	fd = timerfd_create(timer_clockid(), TFD_CLOEXEC);
 	if (fd == -1) {
 		perror("timerfd_create");
 		return -1;
@@ -184,13 +534,63 @@ static int timer_fd_init(int epoll_fd)
 static void usage(bool error)
 {
 	fprintf(error ? stderr : stdout,
-		"usage: %s [--icons PATH] [--wordy]\n"
+		"usage: %s [--align] [--config PATH] [--control PATH] [--icons PATH]\n"
+		"          [--plugins DIR] [--root DIR] [--max-rate HZ] [--wordy]\n"
+		"          [--startup-report] [--profile[=PATH]] [--trace PATH]\n"
+		"          [--output OUTPUT]... [--snapshot[=PATH]]\n"
 		"\n"
-		"Gather system information and set the root window name\n"
+		"Gather system information and show it in a status bar\n"
 		"\n"
 		"Options:\n"
+		"  -a, --align         align updates to wall clock boundaries\n"
+		"  -f, --config PATH   read the sections to show from PATH (default:\n"
+		"                      $XDG_CONFIG_HOME/verbar/config)\n"
+		"  -c, --control PATH  accept commands on a Unix socket at PATH\n"
 		"  -i, --icons PATH    directory containing icon files\n"
+		"  -p, --plugins DIR   directory containing section plugins\n"
+		"  -R, --root DIR      read /proc and /sys under DIR instead of /\n"
+		"  -r, --max-rate HZ   update at most HZ times per second (default:\n"
+		"                      20, 0 means no limit)\n"
 		"  -w, --wordy         enable wordy output on startup\n"
+		"  -s, --startup-report\n"
+		"                      print how long each section took to\n"
+		"                      initialize\n"
+		"  -P, --profile[=PATH]\n"
+		"                      periodically write the CPU cost of each\n"
+		"                      section and of rendering to PATH (default:\n"
+		"                      stderr)\n"
+		"  -T, --trace PATH    write a Chrome trace of ticks, section\n"
+		"                      updates, callbacks, and renders to PATH\n"
+		"  -o, --output OUTPUT where to show the status bar:\n"
+#ifndef NO_XLIB
+		"                      x[:DISPLAY]  root window name (default)\n"
+#endif
+		"                      xcb[:DISPLAY]\n"
+		"                                   root window name without\n"
+		"                                   Xlib or round trips\n"
+#ifdef NO_XLIB
+		"                                   (default)\n"
+#endif
+		"                      stdout       plain lines\n"
+		"                      i3bar        i3bar JSON protocol\n"
+		"                      lemonbar[:l|c|r]\n"
+		"                                   lemonbar input\n"
+		"                      This may be repeated to show the same\n"
+		"                      status in several places. OUTPUT may be\n"
+		"                      followed by \"wordy\" to invert --wordy\n"
+		"                      and by \"sections=NAME,...\" to only show\n"
+		"                      some sections, separated by spaces\n"
+		"  -S, --snapshot[=PATH]\n"
+		"                      publish the output and values of each\n"
+		"                      section to a memory-mapped file at PATH\n"
+		"                      (default:\n"
+		"                      $XDG_RUNTIME_DIR/verbar.snapshot) for\n"
+		"                      other programs; see snapshot.h\n"
+		"\n"
+		"Signals:\n"
+		"  SIGUSR1        toggle wordy output\n"
+		"  SIGUSR2        print update and render latencies, wakeups,\n"
+		"                 and resource usage to stderr\n"
 		"\n"
 		"Miscellaneous:\n"
 		"  -h, --help     display this help message and exit\n",
@@ -201,32 +601,101 @@ static void usage(bool error)
 int main(int argc, char **argv)
 {
 	struct option long_options[] = {
+		{"align", no_argument, NULL, 'a'},
+		{"config", required_argument, NULL, 'f'},
+		{"control", required_argument, NULL, 'c'},
 		{"icons", required_argument, NULL, 'i'},
+		{"plugins", required_argument, NULL, 'p'},
+		{"root", required_argument, NULL, 'R'},
+		{"max-rate", required_argument, NULL, 'r'},
 		{"wordy", no_argument, NULL, 'w'},
+		{"startup-report", no_argument, NULL, 's'},
+		{"profile", optional_argument, NULL, 'P'},
+		{"trace", required_argument, NULL, 'T'},
+		{"output", required_argument, NULL, 'o'},
+		{"snapshot", optional_argument, NULL, 'S'},
 		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0},
 	};
+	const char *config_path = NULL;
+	const char *control_path = NULL;
+	const char *profile_path = NULL;
+	const char *trace_path = NULL;
+	const char *snapshot_path = NULL;
+	char snapshot_buf[PATH_MAX];
+	const char **output_specs = NULL;
+	size_t num_output_specs = 0;
+	bool profile = false;
+	bool snapshot = false;
 	int epoll_fd = -1;
-	struct itimerspec it;
+	long long rate;
 	int ret;
 	int status = EXIT_SUCCESS;
 
 	if (argc > 0)
 		progname = argv[0];
 
+	/* There can't be more outputs than arguments. */
+	output_specs = calloc(argc + 1, sizeof(*output_specs));
+	if (!output_specs) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+
 	for (;;) {
 		int c;
 
-		c = getopt_long(argc, argv, "i:wh", long_options, NULL);
+		c = getopt_long(argc, argv, "af:c:i:p:R:r:wsP::T:o:S::h", long_options, NULL);
 		if (c == -1)
 			break;
 
 		switch (c) {
+		case 'a':
+			align_timers = true;
+			break;
+		case 'f':
+			config_path = optarg;
+			break;
+		case 'c':
+			control_path = optarg;
+			break;
 		case 'i':
 			icon_path = optarg;
 			break;
+		case 'p':
+			plugin_dir = optarg;
+			break;
+		case 'R':
+			host_root = optarg;
+			break;
+		case 'r':
+			if (parse_int(optarg, &rate) || rate < 0 ||
+			    rate > NSEC_PER_SEC) {
+				fprintf(stderr, "invalid rate \"%s\"\n", optarg);
+				usage(true);
+			}
+			max_rate = rate;
+			break;
 		case 'w':
 			wordy = true;
 			break;
+		case 's':
+			startup_report = true;
+			break;
+		case 'P':
+			profile = true;
+			profile_path = optarg;
+			break;
+		case 'T':
+			trace_path = optarg;
+			break;
+		case 'o':
+			output_specs[num_output_specs++] = optarg;
+			break;
+		case 'S':
+			snapshot = true;
+			snapshot_path = optarg;
+			break;
 		case 'h':
 			usage(false);
 		default:
@@ -236,15 +705,6 @@ int main(int argc, char **argv)
 	if (optind != argc)
 		usage(true);
 
-	dpy = XOpenDisplay(NULL);
-	if (!dpy) {
-		fprintf(stderr, "unable to open display '%s'\n",
-			XDisplayName(NULL));
-		status = EXIT_FAILURE;
-		goto out;
-	}
-	root = DefaultRootWindow(dpy);
-
 	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 	if (epoll_fd == -1) {
 		perror("epoll_create1");
@@ -264,55 +724,117 @@ int main(int argc, char **argv)
 		goto out;
 	}
 
-	if (init_sections(epoll_fd, config, sizeof(config) / sizeof(*config))) {
+	ret = render_timer_init(epoll_fd);
+	if (ret == -1) {
 		status = EXIT_FAILURE;
 		goto out;
 	}
-	if (update_timer_sections()) {
+
+	if (!num_output_specs)
+		output_specs[num_output_specs++] = DEFAULT_OUTPUT;
+	sinks = calloc(num_output_specs, sizeof(*sinks));
+	if (!sinks) {
+		perror("calloc");
 		status = EXIT_FAILURE;
 		goto out;
 	}
+	for (; num_sinks < num_output_specs; num_sinks++) {
+		if (open_sink(&sinks[num_sinks], output_specs[num_sinks],
+			      epoll_fd)) {
+			/* Clean up whatever was opened. */
+			num_sinks++;
+			status = EXIT_FAILURE;
+			goto out;
+		}
+	}
 
-	it.it_interval.tv_sec = 1;
-	it.it_interval.tv_nsec = 0;
-	it.it_value.tv_sec = 1;
-	it.it_value.tv_nsec = 0;
-	ret = timerfd_settime(timer_cb.fd, 0, &it, NULL);
-	if (ret == -1) {
-		perror("timerfd_settime");
+	if (profile) {
+		if (init_profile(profile_path, epoll_fd)) {
+			status = EXIT_FAILURE;
+			goto out;
+		}
+		format_profile = profile_entry("render", "format");
+		flush_profile = profile_entry("render", "flush");
+		if (!format_profile || !flush_profile) {
+			status = EXIT_FAILURE;
+			goto out;
+		}
+	}
+
+	if (trace_path && init_trace(trace_path, epoll_fd)) {
+		status = EXIT_FAILURE;
+		goto out;
+	}
+
+	if (snapshot && !snapshot_path) {
+		if (verbar_snapshot_default_path(snapshot_buf,
+						 sizeof(snapshot_buf))) {
+			fprintf(stderr, "XDG_RUNTIME_DIR is not set; use "
+				"--snapshot=PATH\n");
+			status = EXIT_FAILURE;
+			goto out;
+		}
+		snapshot_path = snapshot_buf;
+	}
+	if (snapshot_path && init_snapshot(snapshot_path)) {
+		status = EXIT_FAILURE;
+		goto out;
+	}
+
+	if (control_path && init_control(control_path, epoll_fd)) {
+		status = EXIT_FAILURE;
+		goto out;
+	}
+
+	if (init_plugins() || init_config(config_path, epoll_fd)) {
+		status = EXIT_FAILURE;
+		goto out;
+	}
+	/* Show placeholders until the sections are ready. */
+	if (update_statusbar() || run_timers(false)) {
 		status = EXIT_FAILURE;
 		goto out;
 	}
 
 	while (!quit) {
 		struct epoll_event events[10];
-		int i;
+		int i, num_events;
+
+		if (update) {
+			update = false;
+			ret = render();
+			if (ret) {
+				status = EXIT_FAILURE;
+				goto out;
+			}
+		}
 
-		update = false;
+		ret = arm_timer_fd(timer_cb.fd);
+		if (ret) {
+			status = EXIT_FAILURE;
+			goto out;
+		}
 
-		ret = epoll_wait(epoll_fd, events,
-				 sizeof(events) / sizeof(events[0]),
-				 -1);
-		if (ret == -1) {
+		num_events = epoll_wait(epoll_fd, events,
+					sizeof(events) / sizeof(events[0]), -1);
+		if (num_events == -1) {
 			if (errno == EINTR)
 				continue;
 			perror("epoll_wait");
 			status = EXIT_FAILURE;
 			goto out;
 		}
+		__atomic_fetch_add(&self_stats.wakeups, 1, __ATOMIC_RELAXED);
 
-		for (i = 0; i < ret; i++) {
+		for (i = 0; i < num_events; i++) {
 			struct epoll_callback *cb = events[i].data.ptr;
+			/* The callback may free cb but not its name. */
+			const char *name = cb->name ? cb->name : "epoll";
+			uint64_t start = tracing ? trace_now() : 0;
 
 			ret = cb->callback(cb->fd, cb->data, events[i].events);
-			if (ret) {
-				status = EXIT_FAILURE;
-				goto out;
-			}
-		}
-
-		if (update) {
-			ret = update_statusbar();
+			if (tracing)
+				trace_event("epoll", name, start);
 			if (ret) {
 				status = EXIT_FAILURE;
 				goto out;
@@ -324,16 +846,22 @@ int main(int argc, char **argv)
 out:
 	if (epoll_fd != -1)
 		close(epoll_fd);
+	free_control();
 	free_sections();
+	free_profile();
+	free_trace();
+	free_snapshot();
+	free_plugins();
+	free_config();
+	if (render_timer_cb.fd != -1)
+		close(render_timer_cb.fd);
 	if (timer_cb.fd != -1)
 		close(timer_cb.fd);
 	if (signal_cb.fd != -1)
 		close(signal_cb.fd);
-	str_free(&status_str);
-	if (dpy) {
-		XStoreName(dpy, root, "");
-		XFlush(dpy);
-		XCloseDisplay(dpy);
-	}
+	while (num_sinks)
+		close_sink(&sinks[--num_sinks]);
+	free(sinks);
+	free(output_specs);
 	return status;
 }
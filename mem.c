@@ -26,13 +26,14 @@ struct mem_section {
 	/* Memory usage as a percent. */
 	double mem_usage;
 
+	char *path;
 	char *buf;
 	size_t n;
 };
 
 static void mem_free(void *data);
 
-static void *mem_init(int epoll_fd)
+static void *mem_init(int epoll_fd, char * const *options)
 {
 	struct mem_section *section;
 
@@ -41,10 +42,17 @@ static void *mem_init(int epoll_fd)
 		perror("malloc");
 		return NULL;
 	}
+	section->mem_usage = 0.0;
 	section->n = 100;
 	section->buf = malloc(section->n);
 	if (!section->buf) {
 		perror("malloc");
+		section->path = NULL;
+		mem_free(section);
+		return NULL;
+	}
+	section->path = host_path("/proc/meminfo");
+	if (!section->path) {
 		mem_free(section);
 		return NULL;
 	}
@@ -54,6 +62,7 @@ static void *mem_init(int epoll_fd)
 static void mem_free(void *data)
 {
 	struct mem_section *section = data;
+	free(section->path);
 	free(section->buf);
 	free(section);
 }
@@ -61,17 +70,16 @@ static void mem_free(void *data)
 static int mem_update(void *data)
 {
 	struct mem_section *section = data;
+	double mem_usage;
 	FILE *file;
 	int status;
 	long long memtotal = -1;
 	long long memavailable = -1;
 
-	file = fopen("/proc/meminfo", "rb");
+	file = fopen(section->path, "rb");
 	if (!file) {
-		if (errno == ENOENT) {
-			fprintf(stderr, "/proc/meminfo does not exist\n");
-			return 0;
-		}
+		if (errno == ENOENT)
+			return SECTION_UNAVAILABLE;
 		perror("fopen(\"/proc/meminfo\")");
 		return -1;
 	}
@@ -88,17 +96,18 @@ static int mem_update(void *data)
 	}
 	if (memtotal < 0) {
 		fprintf(stderr, "Missing MemTotal in /proc/meminfo\n");
-		status = 0;
+		status = -1;
 		goto out;
 	}
 	if (memavailable < 0) {
 		fprintf(stderr, "Missing MemAvailable in /proc/meminfo\n");
-		status = 0;
+		status = -1;
 		goto out;
 	}
 
-	section->mem_usage = 100.0 * ((double)(memtotal - memavailable) / memtotal);
-	status = 0;
+	mem_usage = 100.0 * ((double)(memtotal - memavailable) / memtotal);
+	status = mem_usage != section->mem_usage;
+	section->mem_usage = mem_usage;
 out:
 	fclose(file);
 	return status;
@@ -114,11 +123,25 @@ static int mem_append(void *data, struct str *str, bool wordy)
 	return str_separator(str);
 }
 
+static size_t mem_values(void *data, struct section_value *values,
+			 size_t max)
+{
+	struct mem_section *section = data;
+
+	if (max < 1)
+		return 0;
+	values[0].key = "usage";
+	values[0].value = section->mem_usage;
+	return 1;
+}
+
 static const struct section mem_section = {
 	.name = "mem",
 	.init = mem_init,
 	.free = mem_free,
 	.timer_update = mem_update,
+	.period = 5000,
 	.append = mem_append,
+	.values = mem_values,
 };
 register_section(mem_section);
@@ -30,6 +30,7 @@
 #include <linux/nl80211.h>
 #include <linux/rtnetlink.h>
 
+#include "probes.h"
 #include "verbar.h"
 
 struct nic {
@@ -95,11 +96,15 @@ static int run_nlmsg(struct mnl_socket *nl, struct nlmsghdr *nlh, char *buf,
 {
 	unsigned int portid = mnl_socket_get_portid(nl);
 	unsigned int seq = nlh->nlmsg_seq;
+	int status = 0;
+
+	PROBE2(netlink__start, nlh->nlmsg_type, seq);
 
 	nlh->nlmsg_pid = portid;
 	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) == -1) {
 		perror("mnl_socket_sendto");
-		return -1;
+		status = -1;
+		goto out;
 	}
 
 	for (;;) {
@@ -108,7 +113,8 @@ static int run_nlmsg(struct mnl_socket *nl, struct nlmsghdr *nlh, char *buf,
 		ret = mnl_socket_recvfrom(nl, buf, buflen);
 		if (ret == -1) {
 			perror("mnl_socket_recvfrom");
-			return -1;
+			status = -1;
+			goto out;
 		} else if (ret == 0) {
 			break;
 		}
@@ -116,12 +122,15 @@ static int run_nlmsg(struct mnl_socket *nl, struct nlmsghdr *nlh, char *buf,
 		ret = mnl_cb_run(buf, ret, seq, portid, cb, data);
 		if (ret == MNL_CB_ERROR) {
 			perror("mnl_cb_run");
-			return -1;
+			status = -1;
+			goto out;
 		} else if (ret == MNL_CB_STOP) {
 			break;
 		}
 	}
-	return 0;
+out:
+	PROBE2(netlink__end, seq, status);
+	return status;
 }
 
 static int nl80211_id_cb(const struct nlmsghdr *nlh, void *data)
@@ -460,7 +469,7 @@ again2:
 
 static void net_free(void *data);
 
-static void *net_init(int epoll_fd)
+static void *net_init(int epoll_fd, char * const *options)
 {
 	struct net_section *section;
 
@@ -482,10 +491,8 @@ static void *net_init(int epoll_fd)
 	return section;
 }
 
-static void free_nics(struct net_section *section)
+static void free_nic_list(struct nic *nic)
 {
-	struct nic *nic = section->nics_head;
-
 	while (nic) {
 		struct nic *next = nic->next;
 		free(nic->name);
@@ -493,11 +500,39 @@ static void free_nics(struct net_section *section)
 		free(nic);
 		nic = next;
 	}
+}
 
+static void free_nics(struct net_section *section)
+{
+	free_nic_list(section->nics_head);
 	section->nics_head = NULL;
 	section->nics_tail = NULL;
 }
 
+static bool nic_equal(const struct nic *a, const struct nic *b)
+{
+	return (a->ifindex == b->ifindex &&
+		a->have_addr == b->have_addr &&
+		a->is_wifi == b->is_wifi &&
+		a->have_wifi_signal == b->have_wifi_signal &&
+		a->signal == b->signal &&
+		strcmp(a->name, b->name) == 0 &&
+		a->ssid_len == b->ssid_len &&
+		(!a->ssid) == (!b->ssid) &&
+		(!a->ssid || memcmp(a->ssid, b->ssid, a->ssid_len) == 0));
+}
+
+static bool nic_list_equal(const struct nic *a, const struct nic *b)
+{
+	while (a && b) {
+		if (!nic_equal(a, b))
+			return false;
+		a = a->next;
+		b = b->next;
+	}
+	return !a && !b;
+}
+
 static void net_free(void *data)
 {
 	struct net_section *section = data;
@@ -513,26 +548,37 @@ static void net_free(void *data)
 static int net_update(void *data)
 {
 	struct net_section *section = data;
-	struct nic *nic;
+	struct nic *prev_nics, *nic;
+	int status;
 
-	free_nics(section);
+	prev_nics = section->nics_head;
+	section->nics_head = section->nics_tail = NULL;
 
-	if (enumerate_nics(section))
-		return -1;
+	if (enumerate_nics(section)) {
+		status = -1;
+		goto out;
+	}
 
-	if (find_wifi_nics(section))
-		return -1;
+	if (find_wifi_nics(section)) {
+		status = -1;
+		goto out;
+	}
 
 	nic = section->nics_head;
 	while (nic) {
 		if (nic->is_wifi) {
-			if (get_wifi_info(section, nic))
-				return -1;
+			if (get_wifi_info(section, nic)) {
+				status = -1;
+				goto out;
+			}
 		}
 		nic = nic->next;
 	}
 
-	return 0;
+	status = !nic_list_equal(prev_nics, section->nics_head);
+out:
+	free_nic_list(prev_nics);
+	return status;
 }
 
 static int append_nic(const struct nic *nic, struct str *str, bool wordy)
@@ -624,6 +670,8 @@ static const struct section net_section = {
 	.init = net_init,
 	.free = net_free,
 	.timer_update = net_update,
+	.blocking = true,
+	.period = 5000,
 	.append = net_append,
 };
 register_section(net_section);
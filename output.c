@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+enum escape {
+	ESCAPE_NONE,
+	ESCAPE_JSON,
+	ESCAPE_LEMONBAR,
+};
+
+/* An output that writes lines of text to stdout. */
+struct text_output {
+	struct output output;
+	int fd;
+
+	/* Each frame is built here and written with one write(). */
+	struct str buf;
+
+	/* lemonbar alignment, e.g., "%{r}". */
+	char align[8];
+
+	/* The JSON for each block of the last frame, for i3bar. */
+	struct i3bar_block *blocks;
+	size_t blocks_cap;
+};
+
+struct i3bar_block {
+	char *name;
+	struct str text;
+	struct str json;
+};
+
+static const struct output_backend stdout_backend;
+static const struct output_backend i3bar_backend;
+static const struct output_backend lemonbar_backend;
+
+static const struct output_backend *backends[] = {
+#ifndef NO_XLIB
+	&x_backend,
+#endif
+	&xcb_backend,
+	&stdout_backend,
+	&i3bar_backend,
+	&lemonbar_backend,
+};
+
+#define container_of(ptr, type, member)			\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Strip the separator that sections end with. */
+static size_t trim_separator(const char *text, size_t len)
+{
+	if (len >= 3 && memcmp(text + len - 3, " | ", 3) == 0)
+		return len - 3;
+	return len;
+}
+
+/*
+ * Append text for a backend that doesn't understand dwm icons (which are
+ * dropped), escaping it for the given format.
+ */
+static int append_text(struct str *str, const char *text, size_t len,
+		       enum escape escape)
+{
+	char buf[8];
+	size_t i;
+	int ret;
+
+	for (i = 0; i < len; i++) {
+		if (text[i] == '\x1b') {
+			while (i < len && text[i] != '\a')
+				i++;
+			continue;
+		}
+		switch (escape) {
+		case ESCAPE_JSON:
+			if (text[i] == '"' || text[i] == '\\') {
+				buf[0] = '\\';
+				buf[1] = text[i];
+				ret = str_appendn(str, buf, 2);
+			} else if ((unsigned char)text[i] < ' ') {
+				snprintf(buf, sizeof(buf), "\\u%04x",
+					 (unsigned char)text[i]);
+				ret = str_append(str, buf);
+			} else {
+				ret = str_appendn(str, &text[i], 1);
+			}
+			break;
+		case ESCAPE_LEMONBAR:
+			if (text[i] == '%')
+				ret = str_append(str, "%%");
+			else if (text[i] == '\n')
+				ret = str_append(str, " ");
+			else
+				ret = str_appendn(str, &text[i], 1);
+			break;
+		default:
+			if (text[i] == '\n')
+				ret = str_append(str, " ");
+			else
+				ret = str_appendn(str, &text[i], 1);
+			break;
+		}
+		if (ret)
+			return -1;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t ssret;
+
+	while (len) {
+		ssret = write(fd, buf, len);
+		if (ssret == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return -1;
+		}
+		buf += ssret;
+		len -= ssret;
+	}
+	return 0;
+}
+
+static struct output *open_text_output(const struct output_backend *backend)
+{
+	struct text_output *text;
+
+	text = calloc(1, sizeof(*text));
+	if (!text) {
+		perror("calloc");
+		return NULL;
+	}
+	text->output.backend = backend;
+	text->fd = STDOUT_FILENO;
+	/* Fail with EPIPE instead of dying when the reader goes away. */
+	signal(SIGPIPE, SIG_IGN);
+	return &text->output;
+}
+
+static void close_text_output(struct output *output)
+{
+	struct text_output *text = container_of(output, struct text_output,
+						output);
+	size_t i;
+
+	for (i = 0; i < text->blocks_cap; i++) {
+		free(text->blocks[i].name);
+		str_free(&text->blocks[i].text);
+		str_free(&text->blocks[i].json);
+	}
+	free(text->blocks);
+	str_free(&text->buf);
+	free(text);
+}
+
+static struct output *stdout_open(const char *arg, int epoll_fd)
+{
+	if (arg) {
+		fprintf(stderr, "stdout output takes no argument\n");
+		return NULL;
+	}
+	return open_text_output(&stdout_backend);
+}
+
+static int stdout_render(struct output *output, const struct str *status,
+			 const struct block *blocks, size_t num_blocks)
+{
+	struct text_output *text = container_of(output, struct text_output,
+						output);
+	size_t i;
+
+	text->buf.len = 0;
+	for (i = 0; i < num_blocks; i++) {
+		size_t len = blocks[i].len;
+
+		/* Only the separators between sections. */
+		if (i == num_blocks - 1)
+			len = trim_separator(blocks[i].text, len);
+		if (append_text(&text->buf, blocks[i].text, len, ESCAPE_NONE))
+			return -1;
+	}
+	if (str_append(&text->buf, "\n"))
+		return -1;
+	return write_all(text->fd, text->buf.buf, text->buf.len);
+}
+
+static const struct output_backend stdout_backend = {
+	.name = "stdout",
+	.open = stdout_open,
+	.close = close_text_output,
+	.render = stdout_render,
+};
+
+static struct output *lemonbar_open(const char *arg, int epoll_fd)
+{
+	struct text_output *text;
+	struct output *output;
+
+	if (arg && strcmp(arg, "l") != 0 && strcmp(arg, "c") != 0 &&
+	    strcmp(arg, "r") != 0) {
+		fprintf(stderr, "lemonbar alignment must be l, c, or r\n");
+		return NULL;
+	}
+	output = open_text_output(&lemonbar_backend);
+	if (!output)
+		return NULL;
+	text = container_of(output, struct text_output, output);
+	snprintf(text->align, sizeof(text->align), "%%{%s}", arg ? arg : "r");
+	return output;
+}
+
+static int lemonbar_render(struct output *output, const struct str *status,
+			   const struct block *blocks, size_t num_blocks)
+{
+	struct text_output *text = container_of(output, struct text_output,
+						output);
+	size_t i;
+
+	text->buf.len = 0;
+	if (str_append(&text->buf, text->align))
+		return -1;
+	for (i = 0; i < num_blocks; i++) {
+		size_t len = blocks[i].len;
+
+		if (i == num_blocks - 1)
+			len = trim_separator(blocks[i].text, len);
+		if (append_text(&text->buf, blocks[i].text, len,
+				ESCAPE_LEMONBAR))
+			return -1;
+	}
+	if (str_append(&text->buf, " \n"))
+		return -1;
+	return write_all(text->fd, text->buf.buf, text->buf.len);
+}
+
+static const struct output_backend lemonbar_backend = {
+	.name = "lemonbar",
+	.open = lemonbar_open,
+	.close = close_text_output,
+	.render = lemonbar_render,
+};
+
+static struct output *i3bar_open(const char *arg, int epoll_fd)
+{
+	struct text_output *text;
+	struct output *output;
+	static const char header[] = "{\"version\":1}\n[\n";
+
+	if (arg) {
+		fprintf(stderr, "i3bar output takes no argument\n");
+		return NULL;
+	}
+	output = open_text_output(&i3bar_backend);
+	if (!output)
+		return NULL;
+	text = container_of(output, struct text_output, output);
+	if (write_all(text->fd, header, sizeof(header) - 1)) {
+		close_text_output(output);
+		return NULL;
+	}
+	return output;
+}
+
+/*
+ * Encode a block unless it is the same as the block that was in its place in
+ * the last frame.
+ */
+static int i3bar_encode(struct i3bar_block *cached, const struct block *block)
+{
+	size_t len = trim_separator(block->text, block->len);
+
+	if (cached->name && strcmp(cached->name, block->name) == 0 &&
+	    cached->text.len == len &&
+	    memcmp(cached->text.buf, block->text, len) == 0)
+		return 0;
+
+	if (!cached->name || strcmp(cached->name, block->name) != 0) {
+		free(cached->name);
+		cached->name = strdup(block->name);
+		if (!cached->name) {
+			perror("strdup");
+			return -1;
+		}
+	}
+	cached->text.len = 0;
+	if (str_appendn(&cached->text, block->text, len))
+		return -1;
+
+	cached->json.len = 0;
+	if (str_append(&cached->json, "{\"name\":\"") ||
+	    append_text(&cached->json, block->name, strlen(block->name),
+			ESCAPE_JSON) ||
+	    str_append(&cached->json, "\",\"full_text\":\"") ||
+	    append_text(&cached->json, block->text, len, ESCAPE_JSON) ||
+	    str_append(&cached->json, "\"}"))
+		return -1;
+	return 0;
+}
+
+static int i3bar_render(struct output *output, const struct str *status,
+			const struct block *blocks, size_t num_blocks)
+{
+	struct text_output *text = container_of(output, struct text_output,
+						output);
+	size_t i;
+
+	if (num_blocks > text->blocks_cap) {
+		struct i3bar_block *new_blocks;
+
+		new_blocks = realloc(text->blocks,
+				     num_blocks * sizeof(*new_blocks));
+		if (!new_blocks) {
+			perror("realloc");
+			return -1;
+		}
+		memset(new_blocks + text->blocks_cap, 0,
+		       (num_blocks - text->blocks_cap) * sizeof(*new_blocks));
+		text->blocks = new_blocks;
+		text->blocks_cap = num_blocks;
+	}
+
+	text->buf.len = 0;
+	if (str_append(&text->buf, "["))
+		return -1;
+	for (i = 0; i < num_blocks; i++) {
+		if (i3bar_encode(&text->blocks[i], &blocks[i]))
+			return -1;
+		if ((i && str_append(&text->buf, ",")) ||
+		    str_appendn(&text->buf, text->blocks[i].json.buf,
+				text->blocks[i].json.len))
+			return -1;
+	}
+	if (str_append(&text->buf, "],\n"))
+		return -1;
+	return write_all(text->fd, text->buf.buf, text->buf.len);
+}
+
+static const struct output_backend i3bar_backend = {
+	.name = "i3bar",
+	.open = i3bar_open,
+	.close = close_text_output,
+	.render = i3bar_render,
+};
+
+struct output *open_output(const char *spec, int epoll_fd)
+{
+	const char *colon, *arg = NULL;
+	size_t len, i;
+
+	colon = strchr(spec, ':');
+	if (colon) {
+		len = colon - spec;
+		arg = colon + 1;
+	} else {
+		len = strlen(spec);
+	}
+	for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+		if (strlen(backends[i]->name) == len &&
+		    strncmp(backends[i]->name, spec, len) == 0)
+			return backends[i]->open(arg, epoll_fd);
+	}
+	fprintf(stderr, "unknown output \"%.*s\"\n", (int)len, spec);
+	return NULL;
+}
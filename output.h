@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+#include "verbar_internal.h"
+
+/* Somewhere to show the status bar. */
+struct output {
+	const struct output_backend *backend;
+};
+
+struct output_backend {
+	const char *name;
+
+	/*
+	 * Open an output. arg is whatever followed "NAME:" in the output
+	 * specification, or NULL.
+	 */
+	struct output *(*open)(const char *arg, int epoll_fd);
+
+	/* Close an output, clearing what it showed if possible. */
+	void (*close)(struct output *output);
+
+	/*
+	 * Show a frame. status is the whole null-terminated status line and
+	 * blocks are the sections that it is made of.
+	 */
+	int (*render)(struct output *output, const struct str *status,
+		      const struct block *blocks, size_t num_blocks);
+};
+
+#ifdef NO_XLIB
+#define DEFAULT_OUTPUT "xcb"
+#else
+#define DEFAULT_OUTPUT "x"
+extern const struct output_backend x_backend;
+#endif
+extern const struct output_backend xcb_backend;
+
+/*
+ * Open an output from a specification like "i3bar" or "x::1": the name of a
+ * backend, optionally followed by a colon and an argument for it.
+ */
+struct output *open_output(const char *spec, int epoll_fd);
+
+static inline void close_output(struct output *output)
+{
+	if (output)
+		output->backend->close(output);
+}
+
+static inline int render_output(struct output *output,
+				const struct str *status,
+				const struct block *blocks, size_t num_blocks)
+{
+	return output->backend->render(output, status, blocks, num_blocks);
+}
+
+#endif /* OUTPUT_H */
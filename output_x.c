@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/Xlib.h>
+
+#include "output.h"
+#include "screen.h"
+
+/* An output that sets the name of the root window, which dwm shows. */
+struct x_output {
+	struct output output;
+	Display *dpy;
+	Window root;
+	/* Whether this display is the one watched for screen blanking. */
+	bool screen_watch;
+};
+
+#define container_of(ptr, type, member)			\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+static bool watching_screen;
+
+static void x_close(struct output *output)
+{
+	struct x_output *x = container_of(output, struct x_output, output);
+
+	if (x->screen_watch) {
+		free_screen_watch();
+		watching_screen = false;
+	}
+	if (x->dpy) {
+		XStoreName(x->dpy, x->root, "");
+		XFlush(x->dpy);
+		XCloseDisplay(x->dpy);
+	}
+	free(x);
+}
+
+static struct output *x_open(const char *arg, int epoll_fd)
+{
+	struct x_output *x;
+
+	x = calloc(1, sizeof(*x));
+	if (!x) {
+		perror("calloc");
+		return NULL;
+	}
+	x->output.backend = &x_backend;
+
+	x->dpy = XOpenDisplay(arg);
+	if (!x->dpy) {
+		fprintf(stderr, "unable to open display '%s'\n",
+			XDisplayName(arg));
+		goto err;
+	}
+	x->root = DefaultRootWindow(x->dpy);
+
+	/* Updates are paused while the first display is blanked. */
+	if (!watching_screen) {
+		if (init_screen_watch(x->dpy, epoll_fd) == -1)
+			goto err;
+		watching_screen = x->screen_watch = true;
+	}
+	return &x->output;
+
+err:
+	x_close(&x->output);
+	return NULL;
+}
+
+static int x_render(struct output *output, const struct str *status,
+		    const struct block *blocks, size_t num_blocks)
+{
+	struct x_output *x = container_of(output, struct x_output, output);
+
+	XStoreName(x->dpy, x->root, status->buf);
+	XFlush(x->dpy);
+	return 0;
+}
+
+const struct output_backend x_backend = {
+	.name = "x",
+	.open = x_open,
+	.close = x_close,
+	.render = x_render,
+};
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <xcb/xcb.h>
+
+#include "output.h"
+
+/*
+ * An output that sets the name of the root window like the X backend, but
+ * without waiting for the server: properties are changed with unchecked
+ * requests, and errors are picked up from the connection in the main loop.
+ */
+struct xcb_output {
+	struct output output;
+	xcb_connection_t *conn;
+	xcb_window_t root;
+	xcb_atom_t net_wm_name;
+	xcb_atom_t utf8_string;
+	struct epoll_callback cb;
+	int epoll_fd;
+};
+
+#define container_of(ptr, type, member)			\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+static xcb_atom_t intern_atom_reply(xcb_connection_t *conn,
+				    xcb_intern_atom_cookie_t cookie,
+				    const char *name)
+{
+	xcb_intern_atom_reply_t *reply;
+	xcb_atom_t atom;
+
+	reply = xcb_intern_atom_reply(conn, cookie, NULL);
+	if (!reply) {
+		fprintf(stderr, "could not intern %s\n", name);
+		return XCB_ATOM_NONE;
+	}
+	atom = reply->atom;
+	free(reply);
+	return atom;
+}
+
+/*
+ * The status is UTF-8, which a STRING property can't hold (it's Latin-1), so
+ * WM_NAME gets the UTF8_STRING type too. dwm only reads WM_NAME and converts
+ * it from whatever type it has.
+ */
+static void set_name(struct xcb_output *xcb, const char *name, size_t len)
+{
+	xcb_change_property(xcb->conn, XCB_PROP_MODE_REPLACE, xcb->root,
+			    XCB_ATOM_WM_NAME, xcb->utf8_string, 8, len, name);
+	xcb_change_property(xcb->conn, XCB_PROP_MODE_REPLACE, xcb->root,
+			    xcb->net_wm_name, xcb->utf8_string, 8, len, name);
+}
+
+static int check_connection(struct xcb_output *xcb)
+{
+	int err;
+
+	err = xcb_connection_has_error(xcb->conn);
+	if (err) {
+		fprintf(stderr, "X connection failed (error %d)\n", err);
+		return -1;
+	}
+	return 0;
+}
+
+static int xcb_fd_callback(int fd, void *data, uint32_t events)
+{
+	struct xcb_output *xcb = data;
+	xcb_generic_event_t *event;
+
+	/* Errors from unchecked requests arrive as events. */
+	while ((event = xcb_poll_for_event(xcb->conn))) {
+		if (event->response_type == 0) {
+			xcb_generic_error_t *error = (void *)event;
+
+			fprintf(stderr,
+				"X error %u for request %u.%u\n",
+				error->error_code, error->major_code,
+				error->minor_code);
+		}
+		free(event);
+	}
+	return check_connection(xcb);
+}
+
+static void xcb_close(struct output *output)
+{
+	struct xcb_output *xcb = container_of(output, struct xcb_output,
+					      output);
+
+	if (xcb->cb.fd != -1)
+		epoll_ctl(xcb->epoll_fd, EPOLL_CTL_DEL, xcb->cb.fd, NULL);
+	if (xcb->conn) {
+		if (!xcb_connection_has_error(xcb->conn)) {
+			set_name(xcb, "", 0);
+			xcb_flush(xcb->conn);
+		}
+		xcb_disconnect(xcb->conn);
+	}
+	free(xcb);
+}
+
+static struct output *xcb_open(const char *arg, int epoll_fd)
+{
+	xcb_intern_atom_cookie_t net_wm_name_cookie, utf8_string_cookie;
+	struct xcb_output *xcb;
+	xcb_screen_iterator_t it;
+	struct epoll_event ev;
+	int screen;
+
+	xcb = calloc(1, sizeof(*xcb));
+	if (!xcb) {
+		perror("calloc");
+		return NULL;
+	}
+	xcb->output.backend = &xcb_backend;
+	xcb->cb.callback = xcb_fd_callback;
+	xcb->cb.fd = -1;
+	xcb->cb.data = xcb;
+	xcb->cb.name = "xcb";
+	xcb->epoll_fd = epoll_fd;
+
+	xcb->conn = xcb_connect(arg, &screen);
+	if (xcb_connection_has_error(xcb->conn)) {
+		fprintf(stderr, "unable to open display '%s'\n",
+			arg ? arg : getenv("DISPLAY") ? getenv("DISPLAY") : "");
+		goto err;
+	}
+	it = xcb_setup_roots_iterator(xcb_get_setup(xcb->conn));
+	for (; it.rem && screen > 0; screen--)
+		xcb_screen_next(&it);
+	if (!it.rem) {
+		fprintf(stderr, "X screen not found\n");
+		goto err;
+	}
+	xcb->root = it.data->root;
+
+	/* This is the only round trip. */
+	net_wm_name_cookie = xcb_intern_atom(xcb->conn, 0,
+					     strlen("_NET_WM_NAME"),
+					     "_NET_WM_NAME");
+	utf8_string_cookie = xcb_intern_atom(xcb->conn, 0,
+					     strlen("UTF8_STRING"),
+					     "UTF8_STRING");
+	xcb->net_wm_name = intern_atom_reply(xcb->conn, net_wm_name_cookie,
+					     "_NET_WM_NAME");
+	xcb->utf8_string = intern_atom_reply(xcb->conn, utf8_string_cookie,
+					     "UTF8_STRING");
+	if (xcb->net_wm_name == XCB_ATOM_NONE ||
+	    xcb->utf8_string == XCB_ATOM_NONE)
+		goto err;
+
+	xcb->cb.fd = xcb_get_file_descriptor(xcb->conn);
+	ev.events = EPOLLIN;
+	ev.data.ptr = &xcb->cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, xcb->cb.fd, &ev) == -1) {
+		perror("epoll_ctl");
+		xcb->cb.fd = -1;
+		goto err;
+	}
+	return &xcb->output;
+
+err:
+	xcb_close(&xcb->output);
+	return NULL;
+}
+
+static int xcb_render(struct output *output, const struct str *status,
+		      const struct block *blocks, size_t num_blocks)
+{
+	struct xcb_output *xcb = container_of(output, struct xcb_output,
+					      output);
+
+	/* Leave out the null terminator. */
+	set_name(xcb, status->buf, status->len ? status->len - 1 : 0);
+	xcb_flush(xcb->conn);
+	return check_connection(xcb);
+}
+
+const struct output_backend xcb_backend = {
+	.name = "xcb",
+	.open = xcb_open,
+	.close = xcb_close,
+	.render = xcb_render,
+};
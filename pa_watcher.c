@@ -24,6 +24,7 @@
 #include <pulse/pulseaudio.h>
 
 #include "pa_watcher.h"
+#include "probes.h"
 
 static pa_mainloop *mainloop;
 static pa_context *context;
@@ -63,6 +64,7 @@ static void send_sink_volume_callback(pa_context *c, const pa_sink_info *i,
 	memset(&volume, 0, sizeof(volume));
 	volume.muted = i->mute;
 	volume.volume = volume_pct_from_cv(&i->volume);
+	PROBE2(pa__send, volume.muted, (int)volume.volume);
 	ssret = write(pipefd, &volume, sizeof(volume));
 	if (ssret == -1) {
 		perror("pipefd");
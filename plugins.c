@@ -15,101 +15,1573 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 
+#include "probes.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "trace.h"
 #include "verbar_internal.h"
 
+#ifndef PLUGINDIR
+#define PLUGINDIR "/usr/local/lib/verbar"
+#endif
+
+const char *plugin_dir = PLUGINDIR;
+
 extern struct section *__start_verbar_sections;
 extern struct section *__stop_verbar_sections;
 
+/*
+ * Section plugin found by init_plugins(). It is only loaded once a
+ * configuration uses it.
+ */
+struct plugin {
+	char *name;
+	void *handle;
+	const struct section *section;
+	bool failed;
+	struct plugin *next;
+};
+
+static struct plugin *plugins;
+
+#define container_of(ptr, type, member)			\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Bit in instance->dirty for the terse or wordy output. */
+#define DIRTY(wordy) (1u << (wordy))
+#define DIRTY_ALL (DIRTY(false) | DIRTY(true))
+
+/* Maximum number of threads for initialization and blocking timer updates. */
+#define MAX_WORKERS 4
+
+/* Default timeout for asynchronous updates in milliseconds. */
+#define DEFAULT_TIMEOUT 5000
+
+/* Factor to slow down polling by while on battery. */
+#define BATTERY_SLOWDOWN 2
+
+/* Maximum delay between retries of a failing section. */
+#define MAX_BACKOFF (5 * 60 * NSEC_PER_SEC)
+
+/*
+ * How long to wait for the worker threads to go idle before initializing a
+ * section which must be initialized on the main thread.
+ */
+#define MAIN_THREAD_INIT_RETRY (NSEC_PER_SEC / 10)
+
+enum section_health {
+	SECTION_OK,
+	/* The last update failed; the section is rendered as degraded. */
+	SECTION_FAILED,
+	/* The source is missing; the section is hidden. */
+	SECTION_MISSING,
+};
+
+/*
+ * Fields used on every tick and render come first so that they share cache
+ * lines; the rest are only used when something changes.
+ */
 struct instance {
 	const struct section *section;
 	void *data;
+
+	/* Next deadline and period of timer updates in nanoseconds. */
+	uint64_t deadline;
+	uint64_t period;
+	size_t timer_index;
+
+	/* Which of the cached outputs below are out of date (see DIRTY()). */
+	unsigned int dirty;
+
+	/*
+	 * Update running on a worker thread or asynchronously on the main loop.
+	 * While an asynchronous update is running, deadline is when it times
+	 * out.
+	 */
+	bool updating;
+
+	/*
+	 * Result of the last initialization or update. Until the first update
+	 * finishes, a placeholder is rendered.
+	 */
+	bool ready;
+	enum section_health health;
+
+	/* Disabled through the control socket. */
+	bool disabled;
+
+	/* Cached output of the last append callback, terse and wordy. */
+	struct str str[2];
+
 	struct instance *next;
+
+	/* The deadline that started the current update. */
+	uint64_t update_deadline;
+	uint64_t timeout;
+	struct work work;
+	int update_ret;
+
+	/*
+	 * Initialization running on a worker thread, its result, and how long
+	 * it took in nanoseconds.
+	 */
+	bool initializing;
+	bool initialized;
+	struct work init_work;
+	void *init_data;
+	uint64_t init_time;
+
+	/* Number of failures in a row, which determines how long we back off. */
+	unsigned int failures;
+
+	/* When an instance without timer updates was last initialized. */
+	uint64_t started;
+
+	/* Time from startup until the first result, for --startup-report. */
+	uint64_t settle_time;
+	bool settled;
+
+	/* Options from the configuration file and whether it was removed. */
+	char **options;
+	bool removed;
+
+	/* Where to attribute the cost of updates and appends for --profile. */
+	struct profile_entry *update_profile, *append_profile;
+
+	/* How long timer updates took, for SIGUSR2. */
+	struct histogram update_latency;
 };
 
+bool align_timers;
+bool startup_report;
+
+/* When init_sections() was called and the number of unsettled sections. */
+static uint64_t startup_time;
+static size_t num_unsettled;
+
+static int main_epoll_fd = -1;
+
+static bool on_battery, screen_blanked;
+
 static struct instance *instances;
 
-static struct section *find_section(const char *name)
+/* Instances removed by reconfigure_sections() while on a worker thread. */
+static struct instance *removed_instances;
+
+/* Min-heap of instances with a timer_update callback, ordered by deadline. */
+static struct instance **timers;
+static size_t num_timers, timers_capacity;
+
+/* Array reused by get_blocks(). */
+static struct block *block_array;
+static size_t blocks_cap;
+
+static void timers_swap(size_t i, size_t j)
+{
+	struct instance *tmp = timers[i];
+
+	timers[i] = timers[j];
+	timers[j] = tmp;
+	timers[i]->timer_index = i;
+	timers[j]->timer_index = j;
+}
+
+static void timers_sift_up(size_t i)
+{
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+
+		if (timers[parent]->deadline <= timers[i]->deadline)
+			break;
+		timers_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void timers_sift_down(size_t i)
+{
+	for (;;) {
+		size_t left = 2 * i + 1, right = 2 * i + 2, min = i;
+
+		if (left < num_timers &&
+		    timers[left]->deadline < timers[min]->deadline)
+			min = left;
+		if (right < num_timers &&
+		    timers[right]->deadline < timers[min]->deadline)
+			min = right;
+		if (min == i)
+			break;
+		timers_swap(i, min);
+		i = min;
+	}
+}
+
+static int timers_push(struct instance *instance)
+{
+	if (num_timers >= timers_capacity) {
+		size_t capacity = timers_capacity ? 2 * timers_capacity : 8;
+		struct instance **tmp;
+
+		tmp = realloc(timers, capacity * sizeof(*timers));
+		if (!tmp) {
+			perror("realloc");
+			return -1;
+		}
+		timers = tmp;
+		timers_capacity = capacity;
+	}
+	timers[num_timers] = instance;
+	instance->timer_index = num_timers;
+	timers_sift_up(num_timers++);
+	return 0;
+}
+
+static void timers_remove(size_t i)
+{
+	if (i != --num_timers) {
+		timers[i] = timers[num_timers];
+		timers[i]->timer_index = i;
+		timers_sift_down(i);
+		timers_sift_up(i);
+	}
+}
+
+/*
+ * Use CLOCK_BOOTTIME rather than CLOCK_MONOTONIC so that the timer fires as
+ * soon as we resume from suspend.
+ */
+clockid_t timer_clockid(void)
+{
+	return align_timers ? CLOCK_REALTIME : CLOCK_BOOTTIME;
+}
+
+static void schedule_timer(struct instance *instance, uint64_t now)
+{
+	uint64_t deadline = UINT64_MAX;
+	uint64_t period = instance->period;
+
+	if (__atomic_load_n(&on_battery, __ATOMIC_RELAXED))
+		period *= BATTERY_SLOWDOWN;
+
+	if (period) {
+		if (instance->deadline && now - instance->deadline >= period) {
+			fprintf(stderr, "warning: %s missed %" PRIu64 " ticks\n",
+				instance->section->name,
+				(now - instance->deadline) / period);
+			__atomic_fetch_add(&self_stats.missed_ticks,
+					   (now - instance->deadline) / period,
+					   __ATOMIC_RELAXED);
+		}
+		if (align_timers) {
+			deadline = now - now % period + period;
+		} else {
+			deadline = instance->deadline + period;
+			if (deadline <= now)
+				deadline = now + period;
+		}
+	}
+	if (instance->section->next_change) {
+		uint64_t delay;
+
+		delay = instance->section->next_change(instance->data);
+		if (delay < deadline - now)
+			deadline = now + delay;
+	}
+	instance->deadline = deadline;
+}
+
+static uint64_t monotonic_now(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return timespec_to_ns(&tp);
+}
+
+uint64_t startup_elapsed(void)
+{
+	return monotonic_now() - startup_time;
+}
+
+static void print_startup_report(void)
+{
+	struct instance *instance;
+
+	for (instance = instances; instance; instance = instance->next) {
+		fprintf(stderr,
+			"startup: %s: init %.3f ms, %s after %.3f ms\n",
+			instance->section->name, instance->init_time / 1e6,
+			instance->health == SECTION_OK ? "ready" :
+			instance->health == SECTION_FAILED ? "failed" :
+			"unavailable",
+			instance->settle_time / 1e6);
+	}
+	fprintf(stderr, "startup: all sections settled after %.3f ms\n",
+		startup_elapsed() / 1e6);
+}
+
+/*
+ * Note the first result of an instance, whether it succeeded or failed, for
+ * --startup-report.
+ */
+static void settle(struct instance *instance)
+{
+	if (instance->settled)
+		return;
+	instance->settled = true;
+	instance->settle_time = startup_elapsed();
+	if (num_unsettled && --num_unsettled == 0 && startup_report)
+		print_startup_report();
+}
+
+static int timer_clock_now(uint64_t *now)
+{
+	struct timespec tp;
+
+	if (verbar_clock_gettime(timer_clockid(), &tp)) {
+		perror("clock_gettime");
+		return -1;
+	}
+	*now = timespec_to_ns(&tp);
+	return 0;
+}
+
+/*
+ * Record the result of an initialization or update and schedule the next
+ * update, backing off exponentially while the section is failing. Returns 1 if
+ * the section needs to be rendered again, 0 otherwise.
+ */
+static int update_health(struct instance *instance, int ret, uint64_t now)
+{
+	enum section_health health;
+	unsigned int shift;
+	uint64_t delay;
+
+	if (ret >= 0) {
+		if (!instance->ready) {
+			instance->ready = true;
+			ret = 1;
+		}
+		if (instance->health != SECTION_OK) {
+			fprintf(stderr, "%s: recovered\n", instance->section->name);
+			instance->health = SECTION_OK;
+			instance->failures = 0;
+			ret = 1;
+		}
+		if (ret > 0)
+			instance->dirty = DIRTY_ALL;
+		schedule_timer(instance, now);
+		settle(instance);
+		return ret > 0;
+	}
+
+	health = ret == SECTION_UNAVAILABLE ? SECTION_MISSING : SECTION_FAILED;
+	if (health != instance->health) {
+		fprintf(stderr, "%s: %s; backing off\n", instance->section->name,
+			health == SECTION_MISSING ? "unavailable" : "failed");
+	}
+
+	delay = instance->period ? instance->period : NSEC_PER_SEC;
+	shift = instance->failures < 16 ? instance->failures : 16;
+	delay <<= shift;
+	if (delay > MAX_BACKOFF)
+		delay = MAX_BACKOFF;
+	instance->failures++;
+	instance->deadline = now + delay;
+
+	if (health == instance->health) {
+		settle(instance);
+		return 0;
+	}
+	instance->health = health;
+	instance->dirty = DIRTY_ALL;
+	settle(instance);
+	return 1;
+}
+
+static bool in_timers(struct instance *instance)
+{
+	return (instance->timer_index < num_timers &&
+		timers[instance->timer_index] == instance);
+}
+
+/*
+ * Instances are normally in the timer heap if they need to be initialized or
+ * updated, except while a worker thread has them.
+ */
+static bool needs_timer(struct instance *instance)
+{
+	return (!instance->initialized || instance->section->timer_update ||
+		instance->section->start_update);
+}
+
+static bool on_worker(struct instance *instance)
+{
+	return (instance->initializing ||
+		(instance->updating && !instance->section->start_update));
+}
+
+/* Abandon an update started by start_update. */
+static void cancel_update(struct instance *instance)
+{
+	if (instance->section->cancel_update)
+		instance->section->cancel_update(instance->data);
+	instance->updating = false;
+}
+
+static void free_options(char **options)
+{
+	char **option;
+
+	if (!options)
+		return;
+	for (option = options; *option; option++)
+		free(*option);
+	free(options);
+}
+
+/*
+ * Free an instance which is not in the timer heap or on a worker thread, or
+ * whose worker thread has been stopped.
+ */
+static void destroy_instance(struct instance *instance)
+{
+	/* Initialization may have finished after the workers stopped. */
+	if (instance->initializing && instance->init_data &&
+	    instance->section->free)
+		instance->section->free(instance->init_data);
+	if (instance->initialized) {
+		if (instance->updating && instance->section->start_update)
+			cancel_update(instance);
+		if (instance->section->free)
+			instance->section->free(instance->data);
+	} else if (instance->data && instance->section->free) {
+		/* The source failed and it wasn't initialized again yet. */
+		instance->section->free(instance->data);
+	}
+	free_options(instance->options);
+	str_free(&instance->str[0]);
+	str_free(&instance->str[1]);
+	free(instance);
+}
+
+/*
+ * Free an instance that was removed from the configuration while a worker
+ * thread had it, now that the worker is done with it.
+ */
+static void reap_instance(struct instance *instance)
+{
+	struct instance **p;
+
+	for (p = &removed_instances; *p; p = &(*p)->next) {
+		if (*p == instance) {
+			*p = instance->next;
+			break;
+		}
+	}
+	destroy_instance(instance);
+}
+
+static void init_work(struct work *work)
+{
+	struct instance *instance = container_of(work, struct instance,
+						 init_work);
+	uint64_t start = monotonic_now();
+
+	instance->init_data = instance->section->init(main_epoll_fd,
+						      instance->options);
+	instance->init_time = monotonic_now() - start;
+}
+
+/*
+ * Finish initializing an instance. The instance must not be in the timer heap.
+ */
+static int finish_init(struct instance *instance)
+{
+	const struct section *section = instance->section;
+	uint64_t now;
+
+	if (instance->removed) {
+		reap_instance(instance);
+		return 0;
+	}
+	instance->initializing = false;
+	if (timer_clock_now(&now))
+		return -1;
+
+	if (section->init && !instance->init_data) {
+		if (update_health(instance, -1, now))
+			request_update();
+		if (instance->disabled)
+			return 0;
+		return timers_push(instance);
+	}
+
+	instance->data = instance->init_data;
+	instance->initialized = true;
+	if (!section->timer_update && !section->start_update) {
+		unsigned int failures = instance->failures;
+
+		if (update_health(instance, 0, now))
+			request_update();
+		/* Keep backing off until section_failed() says otherwise. */
+		instance->failures = failures;
+		instance->started = now;
+		return 0;
+	}
+	/* Run the first update right away. */
+	instance->deadline = now;
+	if (instance->disabled)
+		return 0;
+	return timers_push(instance);
+}
+
+static int init_done(struct work *work)
+{
+	return finish_init(container_of(work, struct instance, init_work));
+}
+
+/*
+ * Initialize an instance on a worker thread if possible. The instance must not
+ * be in the timer heap.
+ */
+static int start_init(struct instance *instance)
+{
+	/* Free what is left of the instance if its source failed. */
+	if (instance->data) {
+		if (instance->section->free)
+			instance->section->free(instance->data);
+		instance->data = NULL;
+	}
+	uint64_t now;
+
+	if (!instance->section->init)
+		return finish_init(instance);
+
+	if (!have_workers()) {
+		instance->initializing = true;
+		init_work(&instance->init_work);
+		return finish_init(instance);
+	}
+	if (!instance->section->main_thread_init) {
+		instance->initializing = true;
+		queue_work(&instance->init_work);
+		return 0;
+	}
+
+	/*
+	 * The section may fork without exec, which isn't safe while other
+	 * threads are running, so stop the workers once they are idle.
+	 */
+	if (outstanding_work()) {
+		if (timer_clock_now(&now))
+			return -1;
+		instance->deadline = now + MAIN_THREAD_INIT_RETRY;
+		if (instance->disabled)
+			return 0;
+		return timers_push(instance);
+	}
+	suspend_workers();
+	instance->initializing = true;
+	init_work(&instance->init_work);
+	if (resume_workers())
+		return -1;
+	return finish_init(instance);
+}
+
+static int call_timer_update(struct instance *instance)
+{
+	struct profile_sample sample;
+	uint64_t start;
+	int ret;
+
+	PROBE1(update__start, instance->section->name);
+	if (instance->update_profile)
+		profile_start(&sample);
+	start = monotonic_now();
+	ret = instance->section->timer_update(instance->data);
+	histogram_add(&instance->update_latency, monotonic_now() - start);
+	if (tracing)
+		trace_event("update", instance->section->name, start);
+	if (instance->update_profile)
+		profile_end(instance->update_profile, &sample);
+	PROBE2(update__end, instance->section->name, ret);
+	return ret;
+}
+
+static int call_append(struct instance *instance, bool wordy)
+{
+	struct profile_sample sample;
+	int ret;
+
+	PROBE1(append__start, instance->section->name);
+	if (instance->append_profile)
+		profile_start(&sample);
+	ret = instance->section->append(instance->data, &instance->str[wordy],
+					wordy);
+	if (instance->append_profile)
+		profile_end(instance->append_profile, &sample);
+	PROBE2(append__end, instance->section->name, ret);
+	return ret;
+}
+
+static void timer_update_work(struct work *work)
+{
+	struct instance *instance = container_of(work, struct instance, work);
+
+	instance->update_ret = call_timer_update(instance);
+}
+
+/*
+ * Finish an update on a worker thread or an asynchronous update. The instance
+ * must not be in the timer heap.
+ */
+static int finish_update(struct instance *instance, int ret)
+{
+	uint64_t now;
+
+	if (instance->removed) {
+		reap_instance(instance);
+		return 0;
+	}
+	instance->updating = false;
+	if (timer_clock_now(&now))
+		return -1;
+	instance->deadline = instance->update_deadline;
+	update_health(instance, ret, now);
+	/* The section may also have been marked dirty while it was updating. */
+	if (instance->dirty)
+		request_update();
+	if (instance->disabled)
+		return 0;
+	return timers_push(instance);
+}
+
+static int timer_update_done(struct work *work)
+{
+	struct instance *instance = container_of(work, struct instance, work);
+
+	return finish_update(instance, instance->update_ret);
+}
+
+static struct instance *find_instance(void *data)
+{
+	struct instance *instance;
+
+	for (instance = instances; instance; instance = instance->next) {
+		if (instance->data == data)
+			return instance;
+	}
+	return NULL;
+}
+
+int section_update_done(void *data, int ret)
+{
+	struct instance *instance = find_instance(data);
+
+	if (!instance || !instance->updating)
+		return 0;
+	timers_remove(instance->timer_index);
+	return finish_update(instance, ret);
+}
+
+int section_failed(void *data)
+{
+	struct instance *instance = find_instance(data);
+	uint64_t now;
+
+	if (!instance || !instance->initialized || on_worker(instance))
+		return 0;
+	if (timer_clock_now(&now))
+		return -1;
+	if (in_timers(instance)) {
+		if (instance->updating)
+			cancel_update(instance);
+		timers_remove(instance->timer_index);
+	}
+	/* Start backing off from scratch if the source was up for a while. */
+	if (now - instance->started >= MAX_BACKOFF)
+		instance->failures = 0;
+	/*
+	 * The callback that reported the failure may still be running, so the
+	 * data is freed by start_init() once the backoff expires.
+	 */
+	instance->initialized = false;
+	update_health(instance, -1, now);
+	request_update();
+	if (instance->disabled)
+		return 0;
+	return timers_push(instance);
+}
+
+void set_on_battery(bool battery)
+{
+	__atomic_store_n(&on_battery, battery, __ATOMIC_RELAXED);
+}
+
+void set_screen_blanked(bool blanked)
+{
+	if (blanked == screen_blanked)
+		return;
+	screen_blanked = blanked;
+	if (!blanked) {
+		reset_timer_sections();
+		dirty_sections();
+		request_update();
+	}
+}
+
+int watch_fd(struct epoll_callback *cb, uint32_t events)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.ptr = cb;
+	if (epoll_ctl(main_epoll_fd, EPOLL_CTL_ADD, cb->fd, &ev) == -1) {
+		if (errno == EEXIST &&
+		    epoll_ctl(main_epoll_fd, EPOLL_CTL_MOD, cb->fd, &ev) == 0)
+			return 0;
+		perror("epoll_ctl");
+		return -1;
+	}
+	return 0;
+}
+
+void unwatch_fd(struct epoll_callback *cb)
+{
+	epoll_ctl(main_epoll_fd, EPOLL_CTL_DEL, cb->fd, NULL);
+}
+
+int init_plugins(void)
+{
+	struct plugin *plugin;
+	struct dirent *ent;
+	DIR *dir;
+	int ret = -1;
+
+	/* Only list the plugins; they are loaded when they are used. */
+	dir = opendir(plugin_dir);
+	if (!dir) {
+		if (errno == ENOENT)
+			return 0;
+		perror(plugin_dir);
+		return -1;
+	}
+	for (;;) {
+		size_t len;
+
+		errno = 0;
+		ent = readdir(dir);
+		if (!ent) {
+			if (errno) {
+				perror("readdir");
+				goto out;
+			}
+			break;
+		}
+		len = strlen(ent->d_name);
+		if (len <= 3 || strcmp(ent->d_name + len - 3, ".so") != 0)
+			continue;
+
+		plugin = calloc(1, sizeof(*plugin));
+		if (!plugin) {
+			perror("calloc");
+			goto out;
+		}
+		plugin->name = strndup(ent->d_name, len - 3);
+		if (!plugin->name) {
+			perror("strndup");
+			free(plugin);
+			goto out;
+		}
+		plugin->next = plugins;
+		plugins = plugin;
+	}
+	ret = 0;
+out:
+	closedir(dir);
+	return ret;
+}
+
+static const struct section *load_plugin(struct plugin *plugin)
+{
+	const struct section * const *section;
+	const unsigned int *abi;
+	void *handle;
+	char *path;
+
+	if (plugin->section || plugin->failed)
+		return plugin->section;
+
+	plugin->failed = true;
+	if (asprintf(&path, "%s/%s.so", plugin_dir, plugin->name) == -1) {
+		perror("asprintf");
+		return NULL;
+	}
+	handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		fprintf(stderr, "%s\n", dlerror());
+		goto out;
+	}
+	abi = dlsym(handle, "verbar_plugin_abi");
+	section = dlsym(handle, "verbar_plugin_section");
+	if (!abi || !section || *abi != VERBAR_ABI_VERSION ||
+	    strcmp((*section)->name, plugin->name) != 0) {
+		fprintf(stderr, "%s: not a compatible verbar plugin\n", path);
+		dlclose(handle);
+		goto out;
+	}
+	plugin->handle = handle;
+	plugin->section = *section;
+	plugin->failed = false;
+out:
+	free(path);
+	return plugin->section;
+}
+
+void free_plugins(void)
+{
+	struct plugin *plugin;
+
+	while (plugins) {
+		plugin = plugins;
+		plugins = plugin->next;
+		if (plugin->handle)
+			dlclose(plugin->handle);
+		free(plugin->name);
+		free(plugin);
+	}
+}
+
+struct section *find_section(const char *name)
 {
 	struct section **section;
 
+	struct plugin *plugin;
+
 	for (section = &__start_verbar_sections;
 	     section < &__stop_verbar_sections;
 	     section++) {
 		if (strcmp((*section)->name, name) == 0)
 			return *section;
 	}
+	for (plugin = plugins; plugin; plugin = plugin->next) {
+		if (strcmp(plugin->name, name) == 0)
+			return (struct section *)load_plugin(plugin);
+	}
 	return NULL;
 }
 
-int init_sections(int epoll_fd, const char **sections, size_t count)
+static unsigned int instance_period(const struct section *section,
+				    const struct section_config *config)
 {
-	struct instance **tail = &instances;
+	unsigned int period;
+
+	period = config->period;
+	if (!period)
+		period = section->period;
+	if (!period && !section->next_change)
+		period = 1000;
+	return period;
+}
+
+static char **dup_options(char * const *options)
+{
+	char **copy;
+	size_t i, n = 0;
+
+	while (options && options[n])
+		n++;
+	copy = calloc(n + 1, sizeof(*copy));
+	if (!copy) {
+		perror("calloc");
+		return NULL;
+	}
+	for (i = 0; i < n; i++) {
+		copy[i] = strdup(options[i]);
+		if (!copy[i]) {
+			perror("strdup");
+			free_options(copy);
+			return NULL;
+		}
+	}
+	return copy;
+}
+
+static bool options_equal(char * const *a, char * const *b)
+{
+	static char * const none[] = {NULL};
+
+	if (!a)
+		a = none;
+	if (!b)
+		b = none;
+	for (; *a && *b; a++, b++) {
+		if (strcmp(*a, *b) != 0)
+			return false;
+	}
+	return !*a && !*b;
+}
+
+static struct instance *new_instance(const struct section_config *config)
+{
+	struct section *section;
+	struct instance *instance;
+
+	section = find_section(config->name);
+	if (!section) {
+		fprintf(stderr, "no section \"%s\"\n", config->name);
+		return NULL;
+	}
+	instance = calloc(1, sizeof(*instance));
+	if (!instance) {
+		perror("calloc");
+		return NULL;
+	}
+	instance->section = section;
+	if (profiling) {
+		instance->update_profile = profile_entry(section->name,
+							 "update");
+		instance->append_profile = profile_entry(section->name,
+							 "append");
+		if (!instance->update_profile || !instance->append_profile) {
+			free(instance);
+			return NULL;
+		}
+	}
+	instance->options = dup_options(config->options);
+	if (!instance->options) {
+		free(instance);
+		return NULL;
+	}
+	instance->dirty = DIRTY_ALL;
+	instance->period = instance_period(section, config) * NSEC_PER_MSEC;
+	instance->timeout = ((section->timeout ? section->timeout :
+			      DEFAULT_TIMEOUT) * NSEC_PER_MSEC);
+	instance->work.run = timer_update_work;
+	instance->work.done = timer_update_done;
+	instance->init_work.run = init_work;
+	instance->init_work.done = init_done;
+	return instance;
+}
+
+/*
+ * Free an instance. If a worker thread has it, it is freed once the worker
+ * hands it back.
+ */
+static void free_instance(struct instance *instance)
+{
+	if (on_worker(instance)) {
+		instance->removed = true;
+		instance->next = removed_instances;
+		removed_instances = instance;
+		return;
+	}
+	if (in_timers(instance))
+		timers_remove(instance->timer_index);
+	destroy_instance(instance);
+}
+
+int reconfigure_sections(const struct section_config *sections, size_t count)
+{
+	struct instance *old = instances, **tail = &instances;
+	struct instance *instance, **p;
+	unsigned int num_workers = 0, num_blocking = 0;
+	bool *reused;
+	uint64_t now;
 	size_t i;
 
-	for (i = 0; i < count; i++) {
-		struct section *section;
-		struct instance *instance;
+	if (timer_clock_now(&now))
+		return -1;
+	reused = calloc(count, sizeof(*reused));
+	if (count && !reused) {
+		perror("calloc");
+		return -1;
+	}
 
-		section = find_section(sections[i]);
-		if (!section) {
-			fprintf(stderr, "no section \"%s\"\n", sections[i]);
-			return -1;
+	/*
+	 * Keep the instances which are still configured with the same options
+	 * and create the rest.
+	 */
+	instances = NULL;
+	for (i = 0; i < count; i++) {
+		for (p = &old; *p; p = &(*p)->next) {
+			if (strcmp((*p)->section->name, sections[i].name) == 0 &&
+			    options_equal((*p)->options, sections[i].options))
+				break;
 		}
-		instance = malloc(sizeof(*instance));
-		instance->section = section;
-		if (instance->section->init) {
-			instance->data = instance->section->init(epoll_fd);
-			if (!instance->data) {
-				free(instance);
-				return -1;
+		if (*p) {
+			uint64_t period;
+
+			instance = *p;
+			*p = instance->next;
+			reused[i] = true;
+			period = (instance_period(instance->section,
+						  &sections[i]) *
+				  NSEC_PER_MSEC);
+			if (period != instance->period) {
+				instance->period = period;
+				if (in_timers(instance) &&
+				    !instance->updating) {
+					timers_remove(instance->timer_index);
+					instance->deadline = now;
+					if (timers_push(instance))
+						goto err;
+				}
 			}
+		} else {
+			instance = new_instance(&sections[i]);
+			if (!instance)
+				goto err;
 		}
 		instance->next = NULL;
+		instance->dirty = DIRTY_ALL;
 		*tail = instance;
 		tail = &instance->next;
+
+		if (instance->section->init &&
+		    !instance->section->main_thread_init)
+			num_workers++;
+		if (instance->section->timer_update &&
+		    instance->section->blocking)
+			num_blocking++;
+	}
+
+	while (old) {
+		instance = old;
+		old = instance->next;
+		free_instance(instance);
+	}
+
+	/*
+	 * Sections which must be initialized on the main thread go first so
+	 * that, on startup, they run before there are any worker threads.
+	 */
+	for (i = 0, instance = instances; instance;
+	     i++, instance = instance->next) {
+		if (!reused[i] && instance->section->main_thread_init &&
+		    start_init(instance))
+			goto err;
+	}
+
+	if (!have_workers()) {
+		if (num_workers < num_blocking)
+			num_workers = num_blocking;
+		if (num_workers > MAX_WORKERS)
+			num_workers = MAX_WORKERS;
+		if (start_workers(main_epoll_fd, num_workers))
+			goto err;
 	}
+
+	/*
+	 * Sections are initialized concurrently and fill in as they become
+	 * ready. If initialization fails, it is retried by
+	 * update_timer_sections().
+	 */
+	for (i = 0, instance = instances; instance;
+	     i++, instance = instance->next) {
+		if (!reused[i] && !instance->section->main_thread_init &&
+		    start_init(instance))
+			goto err;
+	}
+	free(reused);
+	request_update();
 	return 0;
+
+err:
+	/* Put back what's left so that free_sections() can clean it up. */
+	*tail = old;
+	free(reused);
+	return -1;
+}
+
+int init_sections(int epoll_fd, const struct section_config *sections,
+		  size_t count)
+{
+	main_epoll_fd = epoll_fd;
+	startup_time = monotonic_now();
+	num_unsettled = count;
+	return reconfigure_sections(sections, count);
 }
 
 void free_sections(void)
 {
 	struct instance *instance, *next_instance;
 
+	stop_workers();
+
 	instance = instances;
 	while (instance) {
 		next_instance = instance->next;
-		if (instance->section->free)
-			instance->section->free(instance->data);
-		free(instance);
+		destroy_instance(instance);
 		instance = next_instance;
 	}
+	instances = NULL;
+	instance = removed_instances;
+	while (instance) {
+		next_instance = instance->next;
+		destroy_instance(instance);
+		instance = next_instance;
+	}
+	removed_instances = NULL;
+	free(timers);
+	timers = NULL;
+	num_timers = timers_capacity = 0;
+	free(block_array);
+	block_array = NULL;
+	blocks_cap = 0;
 }
 
-int update_timer_sections(void)
+void section_dirty(void *data)
+{
+	struct instance *instance = find_instance(data);
+
+	if (instance)
+		instance->dirty = DIRTY_ALL;
+	request_update();
+}
+
+void print_section_stats(FILE *file)
+{
+	struct instance *instance;
+
+	for (instance = instances; instance; instance = instance->next)
+		print_histogram(file, instance->section->name,
+				&instance->update_latency);
+}
+
+void dirty_sections(void)
 {
 	struct instance *instance;
+
+	for (instance = instances; instance; instance = instance->next)
+		instance->dirty = DIRTY_ALL;
+}
+
+int update_timer_sections(uint64_t now)
+{
+	int changed = 0;
 	int ret;
 
-	for (instance = instances; instance; instance = instance->next) {
-		if (instance->section->timer_update) {
-			ret = instance->section->timer_update(instance->data);
-			if (ret)
+	if (screen_blanked)
+		return 0;
+
+	while (num_timers && timers[0]->deadline <= now) {
+		struct instance *instance = timers[0];
+
+		if (!instance->initialized) {
+			timers_remove(0);
+			if (start_init(instance))
 				return -1;
+			continue;
+		}
+
+		if (instance->updating) {
+			fprintf(stderr, "%s: update timed out\n",
+				instance->section->name);
+			cancel_update(instance);
+			instance->deadline = instance->update_deadline;
+			changed |= update_health(instance, -1, now);
+			timers_sift_down(0);
+			continue;
+		}
+
+		if (instance->section->start_update) {
+			instance->updating = true;
+			instance->update_deadline = instance->deadline;
+			instance->deadline = now + instance->timeout;
+			timers_sift_down(0);
+			/* This may call section_update_done() immediately. */
+			ret = instance->section->start_update(instance->data);
+			if (ret < 0 && instance->updating) {
+				timers_remove(instance->timer_index);
+				if (finish_update(instance, ret))
+					return -1;
+			}
+			continue;
+		}
+
+		if (instance->section->blocking && have_workers()) {
+			/* This is added back to the heap by timer_update_done(). */
+			timers_remove(0);
+			instance->updating = true;
+			instance->update_deadline = instance->deadline;
+			queue_work(&instance->work);
+			continue;
+		}
+
+		ret = call_timer_update(instance);
+		changed |= update_health(instance, ret, now);
+		timers_sift_down(0);
+	}
+	return changed;
+}
+
+void reset_timer_sections(void)
+{
+	struct instance *instance;
+	bool have_now;
+	uint64_t now;
+	size_t i;
+
+	have_now = timer_clock_now(&now) == 0;
+
+	/*
+	 * This includes instances which are currently updating on a worker
+	 * thread. Asynchronous updates are restarted.
+	 */
+	for (instance = instances; instance; instance = instance->next) {
+		/*
+		 * Failing sections keep backing off, but not for longer than
+		 * MAX_BACKOFF from now in case the clock went backwards.
+		 */
+		if (instance->failures) {
+			if (have_now && instance->deadline > now + MAX_BACKOFF)
+				instance->deadline = now + MAX_BACKOFF;
+			continue;
 		}
+		if (instance->updating && instance->section->start_update)
+			cancel_update(instance);
+		instance->deadline = 0;
+		instance->update_deadline = 0;
 	}
+	for (i = num_timers / 2; i-- > 0;)
+		timers_sift_down(i);
+}
+
+uint64_t next_timer_deadline(void)
+{
+	if (screen_blanked || !num_timers)
+		return UINT64_MAX;
+	return timers[0]->deadline;
+}
+
+/*
+ * Render a section which has no output of its own as its name and a marker.
+ * Which section is last depends on what each output shows, so this is always
+ * followed by a separator, and append_sections() removes the last one.
+ */
+static int append_marker(struct instance *instance, struct str *str,
+			 const char *marker)
+{
+	if (str_appendf(str, "%s %s", instance->section->name, marker))
+		return -1;
+	return str_separator(str);
+}
+
+static bool shown(const struct instance *instance, char * const *sections)
+{
+	if (instance->disabled)
+		return false;
+	if (!sections)
+		return true;
+	for (; *sections; sections++) {
+		if (strcmp(*sections, instance->section->name) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Bring the cached terse or wordy output of an instance up to date. */
+static int render_instance(struct instance *instance, bool wordy)
+{
+	struct str *out = &instance->str[wordy];
+	int ret;
+
+	/* Don't race with a worker thread; use the cached output. */
+	if (!(instance->dirty & DIRTY(wordy)) || instance->updating)
+		return 0;
+
+	out->len = 0;
+	switch (instance->health) {
+	case SECTION_OK:
+		if (!instance->ready) {
+			ret = append_marker(instance, out, "...");
+			break;
+		}
+		ret = call_append(instance, wordy);
+		break;
+	case SECTION_FAILED:
+		ret = append_marker(instance, out, "?");
+		break;
+	default:
+		ret = 0;
+		break;
+	}
+	if (ret)
+		return -1;
+	instance->dirty &= ~DIRTY(wordy);
 	return 0;
 }
 
-int append_sections(struct str *str, bool wordy)
+int append_sections(struct str *str, bool wordy, char * const *sections)
 {
 	struct instance *instance;
+	size_t start = str->len;
+	struct str *out;
+
 	for (instance = instances; instance; instance = instance->next) {
-		if (instance->section->append(instance->data, str, wordy))
+		if (!shown(instance, sections))
+			continue;
+
+		if (render_instance(instance, wordy))
+			return -1;
+		out = &instance->str[wordy];
+		if (str_appendn(str, out->buf, out->len))
 			return -1;
 	}
+	/* Only separate sections from each other. */
+	if (str->len - start >= 3 &&
+	    memcmp(str->buf + str->len - 3, " | ", 3) == 0)
+		str->len -= 3;
 	return 0;
 }
+
+int get_blocks(const struct block **blocks, size_t *num_blocks, bool wordy,
+	       char * const *sections)
+{
+	struct instance *instance;
+	size_t n = 0;
+
+	for (instance = instances; instance; instance = instance->next) {
+		if (!shown(instance, sections) || !instance->str[wordy].len)
+			continue;
+		if (n >= blocks_cap) {
+			size_t new_cap = blocks_cap ? 2 * blocks_cap : 16;
+			struct block *new_blocks;
+
+			new_blocks = realloc(block_array,
+					     new_cap * sizeof(*new_blocks));
+			if (!new_blocks) {
+				perror("realloc");
+				return -1;
+			}
+			block_array = new_blocks;
+			blocks_cap = new_cap;
+		}
+		block_array[n].name = instance->section->name;
+		block_array[n].text = instance->str[wordy].buf;
+		block_array[n].len = instance->str[wordy].len;
+		n++;
+	}
+	*blocks = block_array;
+	*num_blocks = n;
+	return 0;
+}
+
+/* Copy the output of an instance without icons or the separator. */
+static void snapshot_text(char *buf, size_t size, const struct str *str)
+{
+	size_t i, j = 0, len = str->len;
+
+	if (len >= 3 && memcmp(str->buf + len - 3, " | ", 3) == 0)
+		len -= 3;
+	for (i = 0; i < len && j < size - 1; i++) {
+		if (str->buf[i] == '\x1b') {
+			while (i < len && str->buf[i] != '\a')
+				i++;
+			continue;
+		}
+		buf[j++] = str->buf[i];
+	}
+	buf[j] = '\0';
+}
+
+void snapshot_sections(struct verbar_snapshot *snapshot)
+{
+	struct section_value values[VERBAR_SNAPSHOT_MAX_VALUES];
+	struct verbar_snapshot_section *out;
+	struct instance *instance;
+	size_t i, n = 0, num_values;
+
+	for (instance = instances;
+	     instance && n < VERBAR_SNAPSHOT_MAX_SECTIONS;
+	     instance = instance->next) {
+		const struct section *section = instance->section;
+
+		if (instance->disabled)
+			continue;
+		out = &snapshot->sections[n++];
+		if (strncmp(out->name, section->name, sizeof(out->name)) != 0) {
+			out->text[0] = '\0';
+			out->num_values = 0;
+		}
+		strncpy(out->name, section->name, sizeof(out->name));
+		out->name[sizeof(out->name) - 1] = '\0';
+		if (instance->health == SECTION_FAILED)
+			out->health = VERBAR_SNAPSHOT_FAILED;
+		else if (instance->health == SECTION_MISSING)
+			out->health = VERBAR_SNAPSHOT_UNAVAILABLE;
+		else if (!instance->ready)
+			out->health = VERBAR_SNAPSHOT_PENDING;
+		else
+			out->health = VERBAR_SNAPSHOT_OK;
+
+		/* Like append, values can't be read during an update. */
+		if (instance->updating)
+			continue;
+		/* The terse output, whichever one the bar shows. */
+		if (render_instance(instance, false))
+			continue;
+		snapshot_text(out->text, sizeof(out->text), &instance->str[0]);
+		num_values = 0;
+		if (section->values && instance->ready &&
+		    instance->health == SECTION_OK) {
+			num_values = section->values(instance->data, values,
+						     VERBAR_SNAPSHOT_MAX_VALUES);
+		}
+		for (i = 0; i < num_values; i++) {
+			strncpy(out->values[i].key, values[i].key,
+				sizeof(out->values[i].key));
+			out->values[i].key[sizeof(out->values[i].key) - 1] =
+				'\0';
+			out->values[i].value = values[i].value;
+		}
+		out->num_values = num_values;
+	}
+	snapshot->num_sections = n;
+}
+
+int format_statusbar(struct str *str, const struct str *prev, bool wordy,
+		     char * const *sections)
+{
+	str->len = 0;
+
+	if (str_append(str, " "))
+		return -1;
+
+	if (append_sections(str, wordy, sections) ||
+	    str_null_terminate(str))
+		return -1;
+
+	return (str->len != prev->len ||
+		memcmp(str->buf, prev->buf, str->len) != 0);
+}
+
+static void disable_instance(struct instance *instance)
+{
+	if (instance->disabled)
+		return;
+	instance->disabled = true;
+	if (in_timers(instance)) {
+		if (instance->updating) {
+			cancel_update(instance);
+			instance->deadline = instance->update_deadline;
+		}
+		timers_remove(instance->timer_index);
+	}
+}
+
+static int enable_instance(struct instance *instance, uint64_t now)
+{
+	if (!instance->disabled)
+		return 0;
+	instance->disabled = false;
+	instance->dirty = DIRTY_ALL;
+	if (on_worker(instance) || !needs_timer(instance))
+		return 0;
+	instance->deadline = now;
+	return timers_push(instance);
+}
+
+int enable_section(const char *name, bool enable)
+{
+	struct instance *instance;
+	int found = 0;
+	uint64_t now;
+
+	if (timer_clock_now(&now))
+		return -1;
+	for (instance = instances; instance; instance = instance->next) {
+		if (strcmp(instance->section->name, name) != 0)
+			continue;
+		if (enable) {
+			if (enable_instance(instance, now))
+				return -1;
+		} else {
+			disable_instance(instance);
+		}
+		found = 1;
+	}
+	if (found)
+		request_update();
+	return found;
+}
+
+int set_section_period(const char *name, unsigned int period)
+{
+	struct instance *instance;
+	int found = 0;
+	uint64_t now;
+
+	if (timer_clock_now(&now))
+		return -1;
+	for (instance = instances; instance; instance = instance->next) {
+		if (strcmp(instance->section->name, name) != 0)
+			continue;
+		instance->period = period * NSEC_PER_MSEC;
+		/* Update it now so that the new period starts from here. */
+		if (in_timers(instance) && !instance->updating) {
+			timers_remove(instance->timer_index);
+			instance->deadline = now;
+			if (timers_push(instance))
+				return -1;
+		}
+		found = 1;
+	}
+	return found;
+}
+
+static const char *instance_state(struct instance *instance)
+{
+	if (instance->disabled)
+		return "disabled";
+	switch (instance->health) {
+	case SECTION_OK:
+		return instance->ready ? "ok" : "pending";
+	case SECTION_FAILED:
+		return "failed";
+	default:
+		return "unavailable";
+	}
+}
+
+int query_sections(struct str *str, const char *name)
+{
+	struct instance *instance;
+	int found = 0;
+
+	for (instance = instances; instance; instance = instance->next) {
+		/* The terse output, whichever one the bar shows. */
+		struct str *out = &instance->str[0];
+		size_t len;
+
+		if (name && strcmp(instance->section->name, name) != 0)
+			continue;
+		if (render_instance(instance, false))
+			return -1;
+		len = out->len;
+		/* Strip the separator. */
+		if (len >= 3 && memcmp(out->buf + len - 3, " | ", 3) == 0)
+			len -= 3;
+		if (str_appendf(str, "%s\t%s\t%" PRIu64 "\t",
+				instance->section->name,
+				instance_state(instance),
+				instance->period / NSEC_PER_MSEC) ||
+		    str_appendn(str, out->buf, len) ||
+		    str_append(str, "\n"))
+			return -1;
+		found = 1;
+	}
+	return found;
+}
@@ -15,6 +15,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -29,11 +30,13 @@ struct power_section {
 
 	/* Battery capacity percentage. */
 	double battery_capacity;
+
+	char *ac_path, *bat_path;
 };
 
 static void power_free(void *data);
 
-static void *power_init(int epoll_fd)
+static void *power_init(int epoll_fd, char * const *options)
 {
 	struct power_section *section;
 
@@ -42,12 +45,22 @@ static void *power_init(int epoll_fd)
 		perror("malloc");
 		return NULL;
 	}
+	section->ac_online = false;
+	section->battery_capacity = 0.0;
+	section->ac_path = host_path(AC);
+	section->bat_path = host_path(BAT);
+	if (!section->ac_path || !section->bat_path) {
+		power_free(section);
+		return NULL;
+	}
 	return section;
 }
 
 static void power_free(void *data)
 {
 	struct power_section *section = data;
+	free(section->bat_path);
+	free(section->ac_path);
 	free(section);
 }
 
@@ -57,22 +70,32 @@ static int power_update(void *data)
 	long long ac_online, battery_capacity;
 	int ret;
 
-	ret = parse_int_file(AC, &ac_online);
+	ret = parse_int_file(section->ac_path, &ac_online);
 	if (ret) {
-		fprintf(stderr, "could not parse %s", AC);
-		return 0;
+		if (errno == ENOENT)
+			return SECTION_UNAVAILABLE;
+		fprintf(stderr, "could not parse %s\n", section->ac_path);
+		return -1;
 	}
 
-	ret = parse_int_file(BAT, &battery_capacity);
+	ret = parse_int_file(section->bat_path, &battery_capacity);
 	if (ret) {
-		fprintf(stderr, "could not parse %s", BAT);
-		return 0;
+		if (errno == ENOENT)
+			return SECTION_UNAVAILABLE;
+		fprintf(stderr, "could not parse %s\n", section->bat_path);
+		return -1;
 	}
 
+	set_on_battery(!ac_online);
+
+	if (section->ac_online == (bool)ac_online &&
+	    section->battery_capacity == (double)battery_capacity)
+		return 0;
+
 	section->ac_online = (bool)ac_online;
 	section->battery_capacity = (double)battery_capacity;
 
-	return 0;
+	return 1;
 }
 
 static int power_append(void *data, struct str *str, bool wordy)
@@ -99,11 +122,28 @@ static int power_append(void *data, struct str *str, bool wordy)
 	return str_separator(str);
 }
 
+static size_t power_values(void *data, struct section_value *values,
+			   size_t max)
+{
+	struct power_section *section = data;
+
+	if (max < 2)
+		return 0;
+	values[0].key = "capacity";
+	values[0].value = section->battery_capacity;
+	values[1].key = "ac";
+	values[1].value = section->ac_online;
+	return 2;
+}
+
 static const struct section power_section = {
 	.name = "power",
 	.init = power_init,
 	.free = power_free,
 	.timer_update = power_update,
+	.blocking = true,
+	.period = 30000,
 	.append = power_append,
+	.values = power_values,
 };
 register_section(power_section);
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes in the "verbar" provider, e.g., for
+ *
+ * bpftrace -e 'usdt:./verbar:update__start { @s[tid] = nsecs; }
+ *              usdt:./verbar:update__end /@s[tid]/ {
+ *                  @[str(arg0)] = hist(nsecs - @s[tid]); }'
+ *
+ * A probe is a single nop until it is attached to. They are compiled in
+ * whenever sys/sdt.h (from SystemTap) is available unless NO_PROBES is defined.
+ */
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROBE(name) DTRACE_PROBE(verbar, name)
+#define PROBE1(name, a) DTRACE_PROBE1(verbar, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(verbar, name, a, b)
+#endif
+#endif
+
+#ifndef PROBE
+#define PROBE(name) do { } while (0)
+#define PROBE1(name, a) do { (void)sizeof(a); } while (0)
+#define PROBE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#endif
+
+#endif /* PROBES_H */
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "profile.h"
+#include "verbar_internal.h"
+
+/* Seconds between summaries. */
+#define PROFILE_INTERVAL 60
+
+struct profile_entry {
+	char *name;
+	const char *stage;
+
+	/* Updated atomically since sections may run on worker threads. */
+	uint64_t calls;
+	uint64_t ns;
+	uint64_t values[NUM_PROFILE_COUNTERS];
+
+	struct profile_entry *next;
+};
+
+/*
+ * Each thread counts itself with its own group of events, which is read all at
+ * once.
+ */
+struct profile_thread {
+	int fds[NUM_PROFILE_COUNTERS];
+	/* Index of each counter in the group, or -1 if it couldn't be opened. */
+	int index[NUM_PROFILE_COUNTERS];
+	int num_open;
+};
+
+static const struct {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} counters[NUM_PROFILE_COUNTERS] = {
+	[PROFILE_CYCLES] = {
+		"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,
+	},
+	[PROFILE_INSTRUCTIONS] = {
+		"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+	},
+	[PROFILE_CONTEXT_SWITCHES] = {
+		"cs", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+	},
+	[PROFILE_PAGE_FAULTS] = {
+		"faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,
+	},
+};
+
+bool profiling;
+
+static FILE *profile_file;
+static struct profile_entry *entries;
+static pthread_key_t thread_key;
+static bool user_only;
+static uint64_t last_summary;
+
+static int summary_timer_callback(int fd, void *data, uint32_t events);
+
+static struct epoll_callback summary_timer_cb = {
+	.callback = summary_timer_callback,
+	.fd = -1,
+	.name = "profile summary",
+};
+
+static uint64_t profile_now(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return timespec_to_ns(&tp);
+}
+
+static void free_thread(void *arg)
+{
+	struct profile_thread *thread = arg;
+	int i;
+
+	for (i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+		if (thread->fds[i] != -1)
+			close(thread->fds[i]);
+	}
+	free(thread);
+}
+
+static int open_counter(int i, int group_fd)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = counters[i].type;
+	attr.config = counters[i].config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_kernel = user_only;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+		       PERF_FLAG_FD_CLOEXEC);
+}
+
+/* Open the calling thread's counters. */
+static struct profile_thread *open_thread(void)
+{
+	struct profile_thread *thread;
+	int i, fd, leader = -1;
+
+	thread = malloc(sizeof(*thread));
+	if (!thread) {
+		perror("malloc");
+		return NULL;
+	}
+	thread->num_open = 0;
+	for (i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+		/*
+		 * Hardware counters are often missing (e.g., in virtual
+		 * machines), so whichever counter opens first leads.
+		 */
+		fd = open_counter(i, leader);
+		thread->fds[i] = fd;
+		if (fd == -1) {
+			thread->index[i] = -1;
+			continue;
+		}
+		if (leader == -1)
+			leader = fd;
+		thread->index[i] = thread->num_open++;
+	}
+	return thread;
+}
+
+static struct profile_thread *get_thread(void)
+{
+	struct profile_thread *thread;
+
+	thread = pthread_getspecific(thread_key);
+	if (!thread) {
+		thread = open_thread();
+		if (thread)
+			pthread_setspecific(thread_key, thread);
+	}
+	return thread;
+}
+
+/* Read the calling thread's counters. Counters that aren't open read as 0. */
+static void read_counters(uint64_t *values)
+{
+	struct profile_thread *thread;
+	uint64_t buf[1 + NUM_PROFILE_COUNTERS];
+	int i;
+
+	memset(values, 0, NUM_PROFILE_COUNTERS * sizeof(*values));
+	thread = get_thread();
+	if (!thread || !thread->num_open)
+		return;
+	/* The first counter that opened is the leader. */
+	for (i = 0; thread->index[i] != 0; i++)
+		;
+	if (read(thread->fds[i], buf, sizeof(buf)) == -1)
+		return;
+	for (i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+		if (thread->index[i] != -1 && thread->index[i] < buf[0])
+			values[i] = buf[1 + thread->index[i]];
+	}
+}
+
+void profile_start(struct profile_sample *sample)
+{
+	read_counters(sample->values);
+	sample->ns = profile_now();
+}
+
+void profile_end(struct profile_entry *entry,
+		 const struct profile_sample *start)
+{
+	uint64_t ns, values[NUM_PROFILE_COUNTERS];
+	int i;
+
+	ns = profile_now();
+	read_counters(values);
+
+	__atomic_fetch_add(&entry->calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&entry->ns, ns - start->ns, __ATOMIC_RELAXED);
+	for (i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+		__atomic_fetch_add(&entry->values[i],
+				   values[i] - start->values[i],
+				   __ATOMIC_RELAXED);
+	}
+}
+
+struct profile_entry *profile_entry(const char *name, const char *stage)
+{
+	struct profile_entry *entry, **p;
+
+	for (p = &entries; *p; p = &(*p)->next) {
+		if (strcmp((*p)->name, name) == 0 &&
+		    strcmp((*p)->stage, stage) == 0)
+			return *p;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		perror("calloc");
+		return NULL;
+	}
+	/* The name may belong to a plugin that gets unloaded. */
+	entry->name = strdup(name);
+	if (!entry->name) {
+		perror("strdup");
+		free(entry);
+		return NULL;
+	}
+	entry->stage = stage;
+	*p = entry;
+	return entry;
+}
+
+/* Print the totals since the last summary and start over. */
+static void print_summary(void)
+{
+	uint64_t calls, ns, values[NUM_PROFILE_COUNTERS], total;
+	struct profile_entry *entry;
+	int share_counter, i;
+	uint64_t now;
+
+	now = profile_now();
+
+	/* Attribute by cycles if we can and by wall time if we can't. */
+	share_counter = PROFILE_CYCLES;
+	total = 0;
+	for (entry = entries; entry; entry = entry->next) {
+		total += __atomic_load_n(&entry->values[PROFILE_CYCLES],
+					 __ATOMIC_RELAXED);
+	}
+	if (!total) {
+		share_counter = -1;
+		for (entry = entries; entry; entry = entry->next)
+			total += __atomic_load_n(&entry->ns, __ATOMIC_RELAXED);
+	}
+
+	fprintf(profile_file, "profile: last %.1f s%s\n",
+		(now - last_summary) / 1e9, user_only ? " (user only)" : "");
+	fprintf(profile_file, "%-10s %-7s %8s %10s %14s %14s %8s %8s %6s\n",
+		"section", "stage", "calls", "us/call", "cycles",
+		"instructions", "cs", "faults", "share");
+	for (entry = entries; entry; entry = entry->next) {
+		calls = __atomic_exchange_n(&entry->calls, 0, __ATOMIC_RELAXED);
+		ns = __atomic_exchange_n(&entry->ns, 0, __ATOMIC_RELAXED);
+		for (i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+			values[i] = __atomic_exchange_n(&entry->values[i], 0,
+							__ATOMIC_RELAXED);
+		}
+		if (!calls)
+			continue;
+
+		fprintf(profile_file,
+			"%-10s %-7s %8" PRIu64 " %10.1f %14" PRIu64 " %14" PRIu64
+			" %8" PRIu64 " %8" PRIu64 " %5.1f%%\n",
+			entry->name, entry->stage, calls, ns / 1e3 / calls,
+			values[PROFILE_CYCLES], values[PROFILE_INSTRUCTIONS],
+			values[PROFILE_CONTEXT_SWITCHES],
+			values[PROFILE_PAGE_FAULTS],
+			total ? 100.0 * (share_counter == -1 ? ns :
+					 values[share_counter]) / total : 0.0);
+	}
+	fflush(profile_file);
+	last_summary = now;
+}
+
+static int summary_timer_callback(int fd, void *data, uint32_t events)
+{
+	uint64_t times;
+	ssize_t ssret;
+
+	ssret = read(fd, &times, sizeof(times));
+	if (ssret == -1) {
+		perror("read(timerfd)");
+		return -1;
+	}
+	assert(ssret == sizeof(times));
+	print_summary();
+	return 0;
+}
+
+int init_profile(const char *path, int epoll_fd)
+{
+	struct profile_thread *thread;
+	struct itimerspec it;
+	struct epoll_event ev;
+	int ret, fd, i;
+
+	if (path) {
+		profile_file = fopen(path, "w");
+		if (!profile_file) {
+			perror("fopen(profile)");
+			return -1;
+		}
+	} else {
+		profile_file = stderr;
+	}
+
+	ret = pthread_key_create(&thread_key, free_thread);
+	if (ret) {
+		fprintf(stderr, "pthread_key_create: %s\n", strerror(ret));
+		return -1;
+	}
+	profiling = true;
+
+	/* We may only be allowed to count userspace. */
+	fd = open_counter(PROFILE_CONTEXT_SWITCHES, -1);
+	if (fd == -1 && errno == EACCES)
+		user_only = true;
+	else if (fd != -1)
+		close(fd);
+
+	/* Find out what we can count up front. */
+	thread = get_thread();
+	if (!thread)
+		return -1;
+	for (i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+		if (thread->fds[i] == -1) {
+			fprintf(stderr, "profile: cannot count %s\n",
+				counters[i].name);
+		}
+	}
+
+	summary_timer_cb.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (summary_timer_cb.fd == -1) {
+		perror("timerfd_create");
+		return -1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &summary_timer_cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, summary_timer_cb.fd,
+		      &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	it.it_interval.tv_sec = PROFILE_INTERVAL;
+	it.it_interval.tv_nsec = 0;
+	it.it_value = it.it_interval;
+	if (timerfd_settime(summary_timer_cb.fd, 0, &it, NULL) == -1) {
+		perror("timerfd_settime");
+		return -1;
+	}
+	last_summary = profile_now();
+	return 0;
+}
+
+void free_profile(void)
+{
+	struct profile_entry *entry, *next;
+	struct profile_thread *thread;
+
+	if (!profiling)
+		return;
+
+	print_summary();
+
+	/* Other threads close their counters when they exit. */
+	thread = pthread_getspecific(thread_key);
+	if (thread) {
+		pthread_setspecific(thread_key, NULL);
+		free_thread(thread);
+	}
+
+	for (entry = entries; entry; entry = next) {
+		next = entry->next;
+		free(entry->name);
+		free(entry);
+	}
+	entries = NULL;
+
+	if (summary_timer_cb.fd != -1) {
+		close(summary_timer_cb.fd);
+		summary_timer_cb.fd = -1;
+	}
+	if (profile_file && profile_file != stderr)
+		fclose(profile_file);
+	profile_file = NULL;
+	profiling = false;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum profile_counter {
+	PROFILE_CYCLES,
+	PROFILE_INSTRUCTIONS,
+	PROFILE_CONTEXT_SWITCHES,
+	PROFILE_PAGE_FAULTS,
+	NUM_PROFILE_COUNTERS,
+};
+
+/* Counters at the start of a profiled call. */
+struct profile_sample {
+	uint64_t ns;
+	uint64_t values[NUM_PROFILE_COUNTERS];
+};
+
+/* Totals for one stage (e.g., a section's update) since the last summary. */
+struct profile_entry;
+
+/* Whether init_profile() was called. */
+extern bool profiling;
+
+/*
+ * Count cycles, instructions, context switches, and page faults with
+ * perf_event_open() for each profiled call, and write a summary to the given
+ * path (or stderr if it is NULL) every so often and on exit.
+ */
+int init_profile(const char *path, int epoll_fd);
+void free_profile(void);
+
+/*
+ * Return the entry for the given stage, creating it if necessary. This must be
+ * called on the main thread.
+ */
+struct profile_entry *profile_entry(const char *name, const char *stage);
+
+/* Attribute the counters between these calls to the given entry. */
+void profile_start(struct profile_sample *sample);
+void profile_end(struct profile_entry *entry,
+		 const struct profile_sample *start);
+
+#endif /* PROFILE_H */
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/dpms.h>
+#include <X11/extensions/scrnsaver.h>
+
+#include "screen.h"
+#include "verbar_internal.h"
+
+/*
+ * The DPMS extension doesn't have events that we can rely on, so poll it.
+ * While the screen is on, a poll costs a wakeup and a round trip to the X
+ * server, so it is only done once a minute: the screen is usually off for
+ * far longer than that, so noticing late wastes little, and the bar itself
+ * rarely needs to wake up more often. While the screen is off, poll more
+ * often so that we notice quickly when it wakes up.
+ */
+#define DPMS_POLL_ON 60
+#define DPMS_POLL_OFF 2
+
+static Display *dpy;
+static bool have_dpms, have_saver;
+static int saver_event_base;
+static bool saver_on, dpms_off;
+
+static int x_fd_callback(int fd, void *data, uint32_t events);
+static int dpms_timer_callback(int fd, void *data, uint32_t events);
+
+static struct epoll_callback x_cb = {
+	.callback = x_fd_callback,
+	.fd = -1,
+	.name = "x11",
+};
+
+static struct epoll_callback dpms_timer_cb = {
+	.callback = dpms_timer_callback,
+	.fd = -1,
+	.name = "dpms timer",
+};
+
+static int arm_dpms_timer(void)
+{
+	struct itimerspec it;
+
+	it.it_interval.tv_sec = dpms_off ? DPMS_POLL_OFF : DPMS_POLL_ON;
+	it.it_interval.tv_nsec = 0;
+	it.it_value = it.it_interval;
+	if (timerfd_settime(dpms_timer_cb.fd, 0, &it, NULL) == -1) {
+		perror("timerfd_settime");
+		return -1;
+	}
+	return 0;
+}
+
+static void handle_x_events(void)
+{
+	XEvent ev;
+
+	while (XPending(dpy)) {
+		XNextEvent(dpy, &ev);
+		if (have_saver &&
+		    ev.type == saver_event_base + ScreenSaverNotify) {
+			XScreenSaverNotifyEvent *sev = (void *)&ev;
+
+			saver_on = sev->state == ScreenSaverOn;
+		}
+	}
+	set_screen_blanked(saver_on || dpms_off);
+}
+
+static int x_fd_callback(int fd, void *data, uint32_t events)
+{
+	handle_x_events();
+	return 0;
+}
+
+static int dpms_timer_callback(int fd, void *data, uint32_t events)
+{
+	uint64_t times;
+	ssize_t ssret;
+	CARD16 level;
+	BOOL enabled;
+	bool off;
+
+	ssret = read(fd, &times, sizeof(times));
+	if (ssret == -1) {
+		perror("read(timerfd)");
+		return -1;
+	}
+	assert(ssret == sizeof(times));
+
+	if (!DPMSInfo(dpy, &level, &enabled))
+		return 0;
+	off = enabled && level != DPMSModeOn;
+	if (off != dpms_off) {
+		dpms_off = off;
+		if (arm_dpms_timer())
+			return -1;
+	}
+	/* The round trip may have queued other events. */
+	handle_x_events();
+	return 0;
+}
+
+int init_screen_watch(Display *display, int epoll_fd)
+{
+	struct epoll_event ev;
+	int dummy;
+
+	dpy = display;
+	have_dpms = DPMSQueryExtension(dpy, &dummy, &dummy) && DPMSCapable(dpy);
+	have_saver = XScreenSaverQueryExtension(dpy, &saver_event_base,
+						&dummy);
+	if (!have_dpms && !have_saver)
+		return 0;
+
+	if (have_saver) {
+		XScreenSaverSelectInput(dpy, DefaultRootWindow(dpy),
+					ScreenSaverNotifyMask);
+		XFlush(dpy);
+	}
+
+	x_cb.fd = ConnectionNumber(dpy);
+	ev.events = EPOLLIN;
+	ev.data.ptr = &x_cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, x_cb.fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+
+	if (!have_dpms)
+		return 0;
+
+	dpms_timer_cb.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (dpms_timer_cb.fd == -1) {
+		perror("timerfd_create");
+		return -1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &dpms_timer_cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dpms_timer_cb.fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	return arm_dpms_timer();
+}
+
+void free_screen_watch(void)
+{
+	if (dpms_timer_cb.fd != -1) {
+		close(dpms_timer_cb.fd);
+		dpms_timer_cb.fd = -1;
+	}
+}
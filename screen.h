@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <X11/Xlib.h>
+
+/*
+ * Watch for the screen being blanked by the screen saver or DPMS and pause
+ * timer updates while it is.
+ */
+int init_screen_watch(Display *dpy, int epoll_fd);
+void free_screen_watch(void);
+
+#endif /* SCREEN_H */
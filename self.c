@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "verbar_internal.h"
+
+/* verbar's own resource usage, from the same counters as the SIGUSR2 dump. */
+struct self_section {
+	/* Values as of the last update. */
+	uint64_t rss;
+	uint64_t cpu_time;
+	uint64_t wakeups;
+	uint64_t time;
+
+	/* CPU usage as a percent and wakeups per minute since the last update. */
+	double cpu_usage;
+	double wakeup_rate;
+};
+
+static void *self_init(int epoll_fd, char * const *options)
+{
+	struct self_section *section;
+
+	section = calloc(1, sizeof(*section));
+	if (!section) {
+		perror("calloc");
+		return NULL;
+	}
+	return section;
+}
+
+static void self_free(void *data)
+{
+	free(data);
+}
+
+static int self_update(void *data)
+{
+	struct self_section *section = data;
+	uint64_t rss, cpu_time, wakeups, time;
+	struct timespec tp;
+
+	if (get_self_usage(&rss, &cpu_time))
+		return -1;
+	if (verbar_clock_gettime(CLOCK_MONOTONIC, &tp)) {
+		perror("clock_gettime");
+		return -1;
+	}
+	time = timespec_to_ns(&tp);
+	wakeups = __atomic_load_n(&self_stats.wakeups, __ATOMIC_RELAXED);
+
+	/* The first update only establishes a baseline for the rates. */
+	if (section->time && time > section->time) {
+		section->cpu_usage = 100.0 * (cpu_time - section->cpu_time) /
+				     (time - section->time);
+		section->wakeup_rate = 60e9 * (wakeups - section->wakeups) /
+				       (time - section->time);
+	}
+	section->rss = rss;
+	section->cpu_time = cpu_time;
+	section->wakeups = wakeups;
+	section->time = time;
+	return 1;
+}
+
+static int self_append(void *data, struct str *str, bool wordy)
+{
+	struct self_section *section = data;
+
+	if (wordy) {
+		if (str_appendf(str, "verbar %.1fM %.1f%% %.0f/min",
+				section->rss / 1048576.0, section->cpu_usage,
+				section->wakeup_rate))
+			return -1;
+	} else {
+		if (str_appendf(str, "verbar %.1f%%", section->cpu_usage))
+			return -1;
+	}
+	return str_separator(str);
+}
+
+static size_t self_values(void *data, struct section_value *values,
+			  size_t max)
+{
+	struct self_section *section = data;
+
+	if (max < 3)
+		return 0;
+	values[0].key = "rss";
+	values[0].value = section->rss;
+	values[1].key = "cpu";
+	values[1].value = section->cpu_usage;
+	values[2].key = "wakeups";
+	values[2].value = section->wakeup_rate;
+	return 3;
+}
+
+static const struct section verbar_section = {
+	.name = "verbar",
+	.init = self_init,
+	.free = self_free,
+	.timer_update = self_update,
+	.period = 10000,
+	.append = self_append,
+	.values = self_values,
+};
+register_section(verbar_section);
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "verbar_internal.h"
+
+static struct verbar_snapshot *snapshot;
+
+/*
+ * The seqlock: readers retry if seq was odd or changed while they copied the
+ * snapshot.
+ */
+static void begin_write(void)
+{
+	__atomic_store_n(&snapshot->seq, snapshot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(void)
+{
+	__atomic_store_n(&snapshot->seq, snapshot->seq + 1, __ATOMIC_RELEASE);
+}
+
+int init_snapshot(const char *path)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	/*
+	 * The file is truncated and overwritten, so don't follow a symlink or
+	 * reuse a file that someone else could have planted.
+	 */
+	fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		perror("open(snapshot)");
+		return -1;
+	}
+	if (fstat(fd, &st) == -1) {
+		perror("fstat(snapshot)");
+		close(fd);
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode) || st.st_uid != getuid() ||
+	    st.st_nlink != 1 || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+		fprintf(stderr,
+			"%s is not a regular file that only we can write\n",
+			path);
+		close(fd);
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(*snapshot)) == -1) {
+		perror("ftruncate(snapshot)");
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, sizeof(*snapshot), PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap(snapshot)");
+		return -1;
+	}
+	snapshot = map;
+
+	/* Keep counting from a previous run so readers see the change. */
+	if (snapshot->seq & 1)
+		snapshot->seq++;
+	begin_write();
+	snapshot->magic = VERBAR_SNAPSHOT_MAGIC;
+	snapshot->version = VERBAR_SNAPSHOT_VERSION;
+	snapshot->size = sizeof(*snapshot);
+	snapshot->pid = getpid();
+	snapshot->num_sections = 0;
+	snapshot->time_ns = 0;
+	end_write();
+	return 0;
+}
+
+void publish_snapshot(void)
+{
+	struct timespec tp;
+
+	if (!snapshot)
+		return;
+	clock_gettime(CLOCK_REALTIME, &tp);
+	begin_write();
+	snapshot_sections(snapshot);
+	snapshot->time_ns = timespec_to_ns(&tp);
+	end_write();
+}
+
+void free_snapshot(void)
+{
+	if (!snapshot)
+		return;
+	begin_write();
+	snapshot->pid = 0;
+	snapshot->num_sections = 0;
+	end_write();
+	munmap(snapshot, sizeof(*snapshot));
+	snapshot = NULL;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*
+ * Layout of the file written by verbar --snapshot and helpers for reading it.
+ * This header only depends on libc so that other programs can include it.
+ *
+ * verbar keeps the file mapped and rewrites it whenever the status bar is
+ * updated. Readers map it read-only and copy it with
+ * verbar_snapshot_read(), which retries until it gets a consistent copy, so
+ * reading never blocks verbar and needs no system calls.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VERBAR_SNAPSHOT_MAGIC 0x70616e73726276ULL /* "vbrsnap" */
+/* Incremented for any change to the layout. */
+#define VERBAR_SNAPSHOT_VERSION 1
+
+#define VERBAR_SNAPSHOT_MAX_SECTIONS 32
+#define VERBAR_SNAPSHOT_MAX_VALUES 4
+#define VERBAR_SNAPSHOT_NAME_LEN 16
+#define VERBAR_SNAPSHOT_TEXT_LEN 128
+
+enum verbar_snapshot_health {
+	VERBAR_SNAPSHOT_OK,
+	VERBAR_SNAPSHOT_PENDING,
+	VERBAR_SNAPSHOT_FAILED,
+	VERBAR_SNAPSHOT_UNAVAILABLE,
+};
+
+struct verbar_snapshot_value {
+	char key[VERBAR_SNAPSHOT_NAME_LEN];
+	double value;
+};
+
+struct verbar_snapshot_section {
+	char name[VERBAR_SNAPSHOT_NAME_LEN];
+	/* enum verbar_snapshot_health. */
+	uint32_t health;
+	uint32_t num_values;
+	struct verbar_snapshot_value values[VERBAR_SNAPSHOT_MAX_VALUES];
+	/* Terse output without the separator or icons, null-terminated. */
+	char text[VERBAR_SNAPSHOT_TEXT_LEN];
+};
+
+struct verbar_snapshot {
+	uint64_t magic;
+	uint32_t version;
+	/* sizeof(struct verbar_snapshot). */
+	uint32_t size;
+	/* Odd while verbar is writing the rest. */
+	uint64_t seq;
+	/* Process ID of verbar, or 0 after it exited. */
+	uint32_t pid;
+	uint32_t num_sections;
+	/* CLOCK_REALTIME of the last update in nanoseconds. */
+	uint64_t time_ns;
+	struct verbar_snapshot_section sections[VERBAR_SNAPSHOT_MAX_SECTIONS];
+};
+
+/*
+ * Get the default path of the snapshot file, $XDG_RUNTIME_DIR/verbar.snapshot,
+ * in buf. There is no fallback in a shared directory like /tmp, where another
+ * user could create the file first. Returns 0 on success or -1 if
+ * XDG_RUNTIME_DIR is not set or the path doesn't fit.
+ */
+static inline int verbar_snapshot_default_path(char *buf, size_t size)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	int ret;
+
+	if (!dir || !*dir)
+		return -1;
+	ret = snprintf(buf, size, "%s/verbar.snapshot", dir);
+	return ret < 0 || (size_t)ret >= size ? -1 : 0;
+}
+
+/*
+ * Map a snapshot file for reading. Returns NULL and sets errno on failure
+ * (EPROTO if it isn't a snapshot file of this version).
+ */
+static inline const struct verbar_snapshot *
+verbar_snapshot_open(const char *path)
+{
+	const struct verbar_snapshot *snapshot;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+	/* Reading past the end of the file would raise SIGBUS. */
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*snapshot)) {
+		close(fd);
+		errno = EPROTO;
+		return NULL;
+	}
+	map = mmap(NULL, sizeof(*snapshot), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	snapshot = map;
+	if (snapshot->magic != VERBAR_SNAPSHOT_MAGIC ||
+	    snapshot->version != VERBAR_SNAPSHOT_VERSION ||
+	    snapshot->size != sizeof(*snapshot)) {
+		munmap(map, sizeof(*snapshot));
+		errno = EPROTO;
+		return NULL;
+	}
+	return snapshot;
+}
+
+static inline void verbar_snapshot_close(const struct verbar_snapshot *snapshot)
+{
+	munmap((void *)snapshot, sizeof(*snapshot));
+}
+
+/*
+ * Copy a consistent snapshot. This retries while verbar is in the middle of an
+ * update, which only takes a few microseconds. Returns 0 on success or -1 with
+ * errno set to EAGAIN if verbar seems to have died in the middle of one.
+ */
+static inline int verbar_snapshot_read(const struct verbar_snapshot *snapshot,
+				       struct verbar_snapshot *copy)
+{
+	unsigned int tries;
+	uint64_t seq;
+
+	for (tries = 0; tries < 1000000; tries++) {
+		seq = __atomic_load_n(&snapshot->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(copy, snapshot, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&snapshot->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+/* Find a section in a copied snapshot by name, or return NULL. */
+static inline const struct verbar_snapshot_section *
+verbar_snapshot_section(const struct verbar_snapshot *snapshot,
+			const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < snapshot->num_sections &&
+	     i < VERBAR_SNAPSHOT_MAX_SECTIONS; i++) {
+		if (strncmp(snapshot->sections[i].name, name,
+			    VERBAR_SNAPSHOT_NAME_LEN) == 0)
+			return &snapshot->sections[i];
+	}
+	return NULL;
+}
+
+#endif /* SNAPSHOT_H */
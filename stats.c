@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "verbar_internal.h"
+
+struct self_stats self_stats;
+
+void histogram_add(struct histogram *histogram, uint64_t ns)
+{
+	uint64_t max;
+	int i;
+
+	i = ns ? 64 - __builtin_clzll(ns) : 0;
+	if (i >= HISTOGRAM_BUCKETS)
+		i = HISTOGRAM_BUCKETS - 1;
+	__atomic_fetch_add(&histogram->buckets[i], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&histogram->total_ns, ns, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&histogram->max_ns, &max, ns, true,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+/* Format a duration with a unit that keeps it short. */
+static const char *format_ns(char *buf, size_t size, double ns)
+{
+	if (ns < 1e3)
+		snprintf(buf, size, "%.0fns", ns);
+	else if (ns < 1e6)
+		snprintf(buf, size, "%.3gus", ns / 1e3);
+	else if (ns < 1e9)
+		snprintf(buf, size, "%.3gms", ns / 1e6);
+	else
+		snprintf(buf, size, "%.3gs", ns / 1e9);
+	return buf;
+}
+
+/* Return the upper bound of the bucket containing the given fraction. */
+static uint64_t histogram_percentile(const uint64_t *buckets, uint64_t count,
+				     double fraction)
+{
+	uint64_t seen = 0;
+	int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+		seen += buckets[i];
+		if (seen >= fraction * count)
+			break;
+	}
+	return UINT64_C(1) << i;
+}
+
+void print_histogram(FILE *file, const char *name,
+		     const struct histogram *histogram)
+{
+	uint64_t buckets[HISTOGRAM_BUCKETS], count, total_ns, max_ns;
+	char buf[4][16];
+	int i;
+
+	/* Writers may be adding to it; this only needs to be close. */
+	count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+	total_ns = __atomic_load_n(&histogram->total_ns, __ATOMIC_RELAXED);
+	max_ns = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+		buckets[i] = __atomic_load_n(&histogram->buckets[i],
+					     __ATOMIC_RELAXED);
+
+	if (!count) {
+		fprintf(file, "%s: no samples\n", name);
+		return;
+	}
+	fprintf(file, "%s: %" PRIu64 " samples, mean %s, p50 < %s, p99 < %s, max %s\n",
+		name, count,
+		format_ns(buf[0], sizeof(buf[0]), (double)total_ns / count),
+		format_ns(buf[1], sizeof(buf[1]),
+			  histogram_percentile(buckets, count, 0.5)),
+		format_ns(buf[2], sizeof(buf[2]),
+			  histogram_percentile(buckets, count, 0.99)),
+		format_ns(buf[3], sizeof(buf[3]), max_ns));
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		if (!buckets[i])
+			continue;
+		format_ns(buf[0], sizeof(buf[0]),
+			  i ? UINT64_C(1) << (i - 1) : 0);
+		if (i == HISTOGRAM_BUCKETS - 1)
+			strcpy(buf[1], "");
+		else
+			format_ns(buf[1], sizeof(buf[1]), UINT64_C(1) << i);
+		fprintf(file, "  [%7s, %7s) %10" PRIu64 "\n", buf[0], buf[1],
+			buckets[i]);
+	}
+}
+
+int get_self_usage(uint64_t *rss, uint64_t *cpu_time)
+{
+	unsigned long size, resident;
+	struct timespec tp;
+	FILE *file;
+	int n;
+
+	/* This is about us, not the host, so it ignores host_root. */
+	file = fopen("/proc/self/statm", "rb");
+	if (!file) {
+		perror("fopen(\"/proc/self/statm\")");
+		return -1;
+	}
+	n = fscanf(file, "%lu %lu", &size, &resident);
+	fclose(file);
+	if (n != 2) {
+		fprintf(stderr, "could not parse /proc/self/statm\n");
+		return -1;
+	}
+	*rss = (uint64_t)resident * sysconf(_SC_PAGESIZE);
+
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tp) == -1) {
+		perror("clock_gettime");
+		return -1;
+	}
+	*cpu_time = timespec_to_ns(&tp);
+	return 0;
+}
+
+void print_self_stats(FILE *file)
+{
+	uint64_t rss, cpu_time;
+
+	fprintf(file, "wakeups: %" PRIu64 "\n",
+		__atomic_load_n(&self_stats.wakeups, __ATOMIC_RELAXED));
+	fprintf(file, "missed ticks: %" PRIu64 "\n",
+		__atomic_load_n(&self_stats.missed_ticks, __ATOMIC_RELAXED));
+	if (get_self_usage(&rss, &cpu_time) == 0) {
+		fprintf(file, "RSS: %" PRIu64 " KiB\n", rss / 1024);
+		fprintf(file, "CPU time: %.3f s\n", cpu_time / 1e9);
+	}
+	print_histogram(file, "render", &self_stats.render);
+	print_section_stats(file);
+	fflush(file);
+}
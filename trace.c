@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "trace.h"
+#include "verbar_internal.h"
+
+/*
+ * Number of events that fit in the ring (a power of two), and how often it is
+ * written out. A frame is a handful of events, so this is plenty.
+ */
+#define TRACE_RING_SIZE 16384
+#define TRACE_INTERVAL_MS 1000
+
+struct trace_event {
+	/* Index of the event plus one once it has been filled in. */
+	uint64_t seq;
+	uint64_t start;
+	uint64_t end;
+	const char *cat;
+	pid_t tid;
+	char name[28];
+};
+
+bool tracing;
+
+static FILE *trace_file;
+static struct trace_event *ring;
+
+/*
+ * Events are reserved at head by any thread and written out from tail by the
+ * main thread.
+ */
+static uint64_t head, tail;
+static uint64_t dropped;
+
+static __thread pid_t trace_tid;
+
+static int flush_timer_callback(int fd, void *data, uint32_t events);
+
+static struct epoll_callback flush_timer_cb = {
+	.callback = flush_timer_callback,
+	.fd = -1,
+	.name = "trace flush",
+};
+
+uint64_t trace_now(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return timespec_to_ns(&tp);
+}
+
+void trace_event(const char *cat, const char *name, uint64_t start)
+{
+	struct trace_event *event;
+	uint64_t end, i;
+
+	end = trace_now();
+	if (!trace_tid)
+		trace_tid = syscall(SYS_gettid);
+
+	i = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	do {
+		if (i - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >=
+		    TRACE_RING_SIZE) {
+			__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&head, &i, i + 1, true,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	event = &ring[i % TRACE_RING_SIZE];
+	event->start = start;
+	event->end = end;
+	event->cat = cat;
+	event->tid = trace_tid;
+	strncpy(event->name, name, sizeof(event->name) - 1);
+	event->name[sizeof(event->name) - 1] = '\0';
+	__atomic_store_n(&event->seq, i + 1, __ATOMIC_RELEASE);
+}
+
+static void print_ts(uint64_t ns)
+{
+	fprintf(trace_file, "%" PRIu64 ".%03u", ns / 1000,
+		(unsigned int)(ns % 1000));
+}
+
+static void print_event(const struct trace_event *event)
+{
+	const char *p;
+
+	fputs(",\n{\"name\":\"", trace_file);
+	for (p = event->name; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			fputc('\\', trace_file);
+		if ((unsigned char)*p >= ' ')
+			fputc(*p, trace_file);
+	}
+	fprintf(trace_file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":",
+		event->cat);
+	print_ts(event->start);
+	fputs(",\"dur\":", trace_file);
+	print_ts(event->end - event->start);
+	fprintf(trace_file, ",\"pid\":%d,\"tid\":%d}", (int)getpid(),
+		(int)event->tid);
+}
+
+/* Write out every event that has been filled in. */
+static int flush_trace(void)
+{
+	struct trace_event *event;
+	uint64_t i, end;
+
+	end = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	for (i = tail; i < end; i++) {
+		event = &ring[i % TRACE_RING_SIZE];
+		/* A worker thread is still filling this one in. */
+		if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) != i + 1)
+			break;
+		print_event(event);
+	}
+	__atomic_store_n(&tail, i, __ATOMIC_RELEASE);
+	if (fflush(trace_file) == EOF) {
+		perror("fflush(trace)");
+		return -1;
+	}
+	return 0;
+}
+
+static int flush_timer_callback(int fd, void *data, uint32_t events)
+{
+	uint64_t times;
+	ssize_t ssret;
+
+	ssret = read(fd, &times, sizeof(times));
+	if (ssret == -1) {
+		perror("read(timerfd)");
+		return -1;
+	}
+	assert(ssret == sizeof(times));
+	return flush_trace();
+}
+
+int init_trace(const char *path, int epoll_fd)
+{
+	struct itimerspec it;
+	struct epoll_event ev;
+
+	ring = calloc(TRACE_RING_SIZE, sizeof(*ring));
+	if (!ring) {
+		perror("calloc");
+		return -1;
+	}
+
+	trace_file = fopen(path, "w");
+	if (!trace_file) {
+		perror("fopen(trace)");
+		return -1;
+	}
+	/*
+	 * The closing bracket is optional in this format, so the file is still
+	 * usable if we don't exit cleanly.
+	 */
+	fprintf(trace_file, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+		"\"args\":{\"name\":\"verbar\"}}", (int)getpid());
+	tracing = true;
+
+	flush_timer_cb.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (flush_timer_cb.fd == -1) {
+		perror("timerfd_create");
+		return -1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &flush_timer_cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, flush_timer_cb.fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	it.it_interval = ns_to_timespec(TRACE_INTERVAL_MS * NSEC_PER_MSEC);
+	it.it_value = it.it_interval;
+	if (timerfd_settime(flush_timer_cb.fd, 0, &it, NULL) == -1) {
+		perror("timerfd_settime");
+		return -1;
+	}
+	return 0;
+}
+
+void free_trace(void)
+{
+	if (trace_file) {
+		flush_trace();
+		fputs("\n]\n", trace_file);
+		if (dropped) {
+			fprintf(stderr, "trace: dropped %" PRIu64 " events\n",
+				dropped);
+		}
+		fclose(trace_file);
+		trace_file = NULL;
+	}
+	if (flush_timer_cb.fd != -1) {
+		close(flush_timer_cb.fd);
+		flush_timer_cb.fd = -1;
+	}
+	free(ring);
+	ring = NULL;
+	tracing = false;
+}
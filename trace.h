@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Whether init_trace() was called. */
+extern bool tracing;
+
+/*
+ * Record the duration of ticks, section updates, epoll callbacks, and renders
+ * in a preallocated ring and write them to the given path in batches in the
+ * Chrome trace event format, which can be opened with Perfetto or
+ * chrome://tracing.
+ */
+int init_trace(const char *path, int epoll_fd);
+void free_trace(void);
+
+/* Return the current time for trace_event(). */
+uint64_t trace_now(void);
+
+/*
+ * Record an event from start until now. The category must be a string
+ * constant; the name is copied. This may be called from any thread and never
+ * blocks; if the ring is full, the event is dropped.
+ */
+void trace_event(const char *cat, const char *name, uint64_t start);
+
+#endif /* TRACE_H */
@@ -24,6 +24,70 @@
 #include "verbar_internal.h"
 
 const char *icon_path;
+const char *host_root;
+
+/*
+ * Virtual clock: when enabled, each clock reads as its value when the virtual
+ * clock was enabled plus virtual_elapsed.
+ */
+static bool virtual_clock;
+static struct timespec virtual_base[3];
+static uint64_t virtual_elapsed;
+
+static int virtual_clock_index(clockid_t clockid)
+{
+	switch (clockid) {
+	case CLOCK_REALTIME:
+		return 0;
+	case CLOCK_MONOTONIC:
+		return 1;
+	case CLOCK_BOOTTIME:
+		return 2;
+	default:
+		return -1;
+	}
+}
+
+int verbar_clock_gettime(clockid_t clockid, struct timespec *tp)
+{
+	int i;
+
+	if (!virtual_clock)
+		return clock_gettime(clockid, tp);
+	i = virtual_clock_index(clockid);
+	if (i < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	*tp = ns_to_timespec(timespec_to_ns(&virtual_base[i]) +
+			     __atomic_load_n(&virtual_elapsed,
+					     __ATOMIC_RELAXED));
+	return 0;
+}
+
+int enable_virtual_clock(void)
+{
+	if (clock_gettime(CLOCK_REALTIME, &virtual_base[0]) ||
+	    clock_gettime(CLOCK_MONOTONIC, &virtual_base[1]) ||
+	    clock_gettime(CLOCK_BOOTTIME, &virtual_base[2])) {
+		perror("clock_gettime");
+		return -1;
+	}
+	virtual_elapsed = 0;
+	virtual_clock = true;
+	return 0;
+}
+
+bool virtual_clock_enabled(void)
+{
+	return virtual_clock;
+}
+
+void advance_virtual_clock(uint64_t ns)
+{
+	__atomic_store_n(&virtual_elapsed, virtual_elapsed + ns,
+			 __ATOMIC_RELAXED);
+}
 
 static int str_realloc(struct str *str, size_t cap)
 {
@@ -130,6 +194,28 @@ int str_append_icon(struct str *str, const char *icon)
 	return str_appendf(str, "\x1b]9;%s/%s.xbm\a", icon_path, icon);
 }
 
+const char *section_option(char * const *options, const char *key)
+{
+	size_t len = strlen(key);
+
+	for (; *options; options++) {
+		if (strncmp(*options, key, len) == 0 && (*options)[len] == '=')
+			return *options + len + 1;
+	}
+	return NULL;
+}
+
+char *host_path(const char *path)
+{
+	char *ret;
+
+	if (asprintf(&ret, "%s%s", host_root ? host_root : "", path) == -1) {
+		perror("asprintf");
+		return NULL;
+	}
+	return ret;
+}
+
 int parse_int(const char *str, long long *ret)
 {
 	char *endptr;
@@ -21,11 +21,17 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
 
 struct epoll_callback {
 	int (*callback)(int, void *, uint32_t);
 	int fd;
 	void *data;
+	/* Name of the callback for --trace, or NULL. */
+	const char *name;
 };
 
 struct str;
@@ -53,37 +59,175 @@ static inline int str_separator(struct str *str)
 	return str_append(str, " | ");
 }
 
+/*
+ * Return the value of the given option from the options passed to init, or
+ * NULL if it wasn't set.
+ */
+const char *section_option(char * const *options, const char *key);
+
 int parse_int(const char *str, long long *ret);
 int parse_int_file(const char *path, long long *ret);
 
+/*
+ * Return the path of a file in /proc or /sys (which may be moved elsewhere,
+ * e.g., to a fixture) as a string that must be freed, or NULL on error.
+ */
+char *host_path(const char *path);
+
+/*
+ * clock_gettime() for sections and the scheduler. This follows the virtual
+ * clock when it is enabled (e.g., by the soak test), so sections must use it
+ * rather than reading the time themselves.
+ */
+int verbar_clock_gettime(clockid_t clockid, struct timespec *tp);
+
+/* Error returned by a section whose source is missing (e.g., no battery). */
+#define SECTION_UNAVAILABLE -2
+
+/* A named number published by a section (e.g., {"usage", 12.5}). */
+struct section_value {
+	const char *key;
+	double value;
+};
+
 struct section {
 	/* Name of the section. */
 	const char *name;
 
 	/*
 	 * Optional callback called to initialize section-specific data. The
-	 * returned pointer will be passed to the other callbacks.
+	 * returned pointer will be passed to the other callbacks. If this
+	 * returns NULL, it is retried with exponential backoff. options is a
+	 * NULL-terminated array of "key=value" strings from the configuration
+	 * file (see section_option()).
 	 */
-	void *(*init)(int epoll_fd);
+	void *(*init)(int epoll_fd, char * const *options);
 
 	/* Option callback called to free section-specific data. */
 	void (*free)(void *data);
 
-	/* Optional callback called on each timer tick. */
+	/*
+	 * Optional callback called on each timer tick. Returns a negative
+	 * value on error, zero if nothing changed, or a positive value if the
+	 * section needs to be rendered again. On error, the section is shown
+	 * as degraded and retried with exponential backoff; if the error is
+	 * SECTION_UNAVAILABLE, it is hidden instead.
+	 */
 	int (*timer_update)(void *data);
 
+	/*
+	 * Optional callback called instead of timer_update to start an
+	 * asynchronous update on the main loop (see watch_fd()). The section
+	 * must call section_update_done() when the update finishes, possibly
+	 * before this returns. Returns a negative value on error.
+	 */
+	int (*start_update)(void *data);
+
+	/*
+	 * Optional callback called if an update started by start_update doesn't
+	 * finish within the timeout or the section is disabled. It must abandon
+	 * the update without calling section_update_done(). Without it, a late
+	 * section_update_done() for an abandoned update is ignored unless
+	 * another update has started.
+	 */
+	void (*cancel_update)(void *data);
+
+	/* Timeout for start_update in milliseconds. Defaults to 5 seconds. */
+	unsigned int timeout;
+
+	/*
+	 * Does timer_update block (e.g., on a socket)? If so, it is called on a
+	 * worker thread, during which the section is not rendered.
+	 */
+	bool blocking;
+
+	/*
+	 * Does init have to run on the main thread (e.g., because it forks a
+	 * child that doesn't exec)? Otherwise, it may run on a worker thread
+	 * concurrently with the initialization of other sections.
+	 */
+	bool main_thread_init;
+
+	/*
+	 * Default period of timer_update in milliseconds. If zero, the section
+	 * is updated every second, unless it has a next_change callback, in
+	 * which case it is only updated when that says so.
+	 */
+	unsigned int period;
+
+	/*
+	 * Optional callback called after timer_update. Returns the number of
+	 * nanoseconds until the output of the section may change on its own
+	 * (e.g., the next frame of an animation), or UINT64_MAX if it won't.
+	 * The section is updated at that time if it is sooner than its period.
+	 */
+	uint64_t (*next_change)(void *data);
+
 	/* Callback called to render the section. */
 	int (*append)(void *data, struct str *str, bool wordy);
+
+	/*
+	 * Optional callback called to get the numbers behind the output for
+	 * --snapshot. Fills in at most max values and returns how many it
+	 * filled in. Like append, it isn't called during an update.
+	 */
+	size_t (*values)(void *data, struct section_value *values, size_t max);
 };
 
+/* Version of struct section and of the functions that sections can call. */
+#define VERBAR_ABI_VERSION 5
+
+#if defined(VERBAR_PLUGIN)
+/* A plugin provides one section, which is looked up by these symbols. */
+#define register_section(var)					\
+	const unsigned int verbar_plugin_abi = VERBAR_ABI_VERSION;	\
+	const struct section *const verbar_plugin_section = &var
+#else
 #define register_section(var)					\
 	static const struct section *_register_##var		\
 	__attribute__((__used__))				\
 	__attribute__((__section__("verbar_sections")))	= &var
+#endif
 
 /*
  * Request an update of the status bar (e.g., from an epoll callback).
  */
 void request_update(void);
 
+/*
+ * Mark the section owning the given data as changed and request an update of
+ * the status bar.
+ */
+void section_dirty(void *data);
+
+/*
+ * Finish an update started by the start_update callback of the section owning
+ * the given data. ret has the same meaning as the return value of
+ * timer_update. Returns a negative value on error.
+ */
+int section_update_done(void *data, int ret);
+
+/*
+ * Report that the source of the section owning the given data failed (e.g., an
+ * event source was closed). The section is shown as failed, freed, and
+ * initialized again with exponential backoff. It must stop watching its file
+ * descriptors before calling this. Returns a negative value on error.
+ */
+int section_failed(void *data);
+
+/*
+ * Report whether the system is running on battery, in which case timer updates
+ * are slowed down. This may be called from a worker thread.
+ */
+void set_on_battery(bool on_battery);
+
+/*
+ * Add a callback to the main loop for the given epoll events, or change the
+ * events if it was already added.
+ */
+int watch_fd(struct epoll_callback *cb, uint32_t events);
+
+/* Remove a callback from the main loop. */
+void unwatch_fd(struct epoll_callback *cb);
+
 #endif /* VERBAR_H */
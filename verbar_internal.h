@@ -18,10 +18,40 @@
 #ifndef VERBAR_INTERNAL_H
 #define VERBAR_INTERNAL_H
 
+#include <stdio.h>
+#include <time.h>
+
 #include "verbar.h"
 
 extern const char *icon_path;
 
+/* Directory that /proc and /sys are found under, or NULL for /. */
+extern const char *host_root;
+
+/*
+ * Align timer deadlines to multiples of their period (used with
+ * CLOCK_REALTIME so that, e.g., the clock ticks on second boundaries).
+ */
+extern bool align_timers;
+
+/* Print per-section initialization times once every section has settled. */
+extern bool startup_report;
+
+/* Return the nanoseconds elapsed since init_sections() was called. */
+uint64_t startup_elapsed(void);
+
+/*
+ * Make verbar_clock_gettime() return virtual time, which starts at the current
+ * time and only moves when advance_virtual_clock() is called. This must be
+ * called before any sections are initialized.
+ */
+int enable_virtual_clock(void);
+bool virtual_clock_enabled(void);
+void advance_virtual_clock(uint64_t ns);
+
+/* Clock used for timer deadlines. */
+clockid_t timer_clockid(void);
+
 struct str {
 	char *buf;
 	size_t len, cap;
@@ -32,10 +62,207 @@ static inline void str_free(struct str *str)
 	free(str->buf);
 }
 
+static inline uint64_t timespec_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static inline struct timespec ns_to_timespec(uint64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / NSEC_PER_SEC,
+		.tv_nsec = ns % NSEC_PER_SEC,
+	};
+	return ts;
+}
+
+/*
+ * Latency histogram with power-of-two buckets: bucket i counts durations in
+ * [2^(i-1), 2^i) nanoseconds, and the last bucket counts everything longer.
+ * Adding to it doesn't allocate or lock, so it can be done from any thread.
+ */
+#define HISTOGRAM_BUCKETS 40
+
+struct histogram {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_add(struct histogram *histogram, uint64_t ns);
+void print_histogram(FILE *file, const char *name,
+		     const struct histogram *histogram);
+
+/* Counters describing verbar itself (see the "verbar" section). */
+struct self_stats {
+	/* Number of times the main loop woke up. */
+	uint64_t wakeups;
+	/* Number of periods by which section updates ran late. */
+	uint64_t missed_ticks;
+	/* Time taken to render each frame. */
+	struct histogram render;
+};
+
+extern struct self_stats self_stats;
+
+/* Get the resident set size in bytes and the CPU time used in nanoseconds. */
+int get_self_usage(uint64_t *rss, uint64_t *cpu_time);
+
+/* Print self_stats and the update latency of every section (on SIGUSR2). */
+void print_self_stats(FILE *file);
+void print_section_stats(FILE *file);
+
+struct work {
+	/* Called on a worker thread. */
+	void (*run)(struct work *work);
+
+	/* Called on the main thread after run returns. */
+	int (*done)(struct work *work);
+
+	struct work *next;
+};
+
+/*
+ * Start a pool of worker threads. Completed work is handed back to the main
+ * thread through an eventfd registered in the given epoll instance.
+ */
+int start_workers(int epoll_fd, unsigned int count);
+void stop_workers(void);
+bool have_workers(void);
+void queue_work(struct work *work);
+
+/* Return how much queued work hasn't been handed back yet. */
+unsigned int outstanding_work(void);
+
+/*
+ * Stop the worker threads without forgetting them so that the main thread can
+ * fork safely, and start them again. There must be no outstanding work.
+ */
+void suspend_workers(void);
+int resume_workers(void);
+
+struct section_config {
+	char *name;
+
+	/*
+	 * Period of timer updates in milliseconds, or zero to use the default
+	 * for the section.
+	 */
+	unsigned int period;
+
+	/*
+	 * NULL-terminated array of "key=value" options passed to the section,
+	 * or NULL if there are none.
+	 */
+	char **options;
+};
+
+/* Directory that section plugins are loaded from. */
+extern const char *plugin_dir;
+
+/*
+ * Find the section plugins in plugin_dir. A plugin named NAME.so provides the
+ * section NAME and is only loaded by find_section() when it is needed.
+ */
 int init_plugins(void);
-int init_sections(int epoll_fd, const char **sections, size_t count);
+void free_plugins(void);
+struct section *find_section(const char *name);
+int init_sections(int epoll_fd, const struct section_config *sections,
+		  size_t count);
+
+/*
+ * Replace the running sections with the given configuration. Instances with
+ * the same name and options are kept along with their state; the rest are
+ * freed or initialized.
+ */
+int reconfigure_sections(const struct section_config *sections, size_t count);
 void free_sections(void);
-int update_timer_sections(void);
-int append_sections(struct str *str, bool wordy);
+void dirty_sections(void);
+
+/*
+ * Call timer_update for every section whose deadline is at or before now (in
+ * nanoseconds). Returns a negative value on error, zero if nothing changed, or
+ * a positive value if the status bar needs to be updated.
+ */
+int update_timer_sections(uint64_t now);
+
+/*
+ * Pause timer updates while the screen is blanked. When it is unblanked, every
+ * section is updated immediately.
+ */
+void set_screen_blanked(bool blanked);
+
+/*
+ * Make every section due immediately (e.g., after the clock jumped or the
+ * system resumed from suspend), except for failing sections, which keep
+ * backing off.
+ */
+void reset_timer_sections(void);
+
+/* Return the earliest deadline of any section, or UINT64_MAX if none. */
+uint64_t next_timer_deadline(void);
+
+/*
+ * Append the output of the sections with the given names (a NULL-terminated
+ * array), or of every section if sections is NULL. Each section is rendered
+ * at most once per change for each of terse and wordy output, however many
+ * times this is called.
+ */
+int append_sections(struct str *str, bool wordy, char * const *sections);
+
+/*
+ * Format the whole status bar into str (null-terminated). Returns 1 if it
+ * differs from prev, 0 if it doesn't, or -1 on error.
+ */
+int format_statusbar(struct str *str, const struct str *prev, bool wordy,
+		     char * const *sections);
+
+/* The output of one section, including its separator. */
+struct block {
+	const char *name;
+	const char *text;
+	size_t len;
+};
+
+/*
+ * Get the output of the given sections as of the last append_sections() with
+ * the same arguments, in order. The array is reused by the next call.
+ */
+int get_blocks(const struct block **blocks, size_t *num_blocks, bool wordy,
+	       char * const *sections);
+
+/*
+ * Publish the output and values of every section to a memory-mapped file at
+ * the given path (see snapshot.h) each time publish_snapshot() is called.
+ */
+int init_snapshot(const char *path);
+void publish_snapshot(void);
+void free_snapshot(void);
+
+struct verbar_snapshot;
+
+/* Fill in the sections of a snapshot; called by publish_snapshot(). */
+void snapshot_sections(struct verbar_snapshot *snapshot);
+
+/*
+ * Enable or disable every instance of the section with the given name. Returns
+ * 1 if there were any, 0 if there weren't, or -1 on error.
+ */
+int enable_section(const char *name, bool enable);
+
+/*
+ * Change the period of timer updates of every instance of the section with the
+ * given name to the given number of milliseconds and update it immediately.
+ * Returns like enable_section().
+ */
+int set_section_period(const char *name, unsigned int period);
+
+/*
+ * Append a line with the name, state, period, and current output of every
+ * instance of the section with the given name, or of every section if name is
+ * NULL. Returns like enable_section().
+ */
+int query_sections(struct str *str, const char *name);
 
 #endif /* VERBAR_INTERNAL_H */
@@ -25,6 +25,7 @@
 #include <sys/types.h>
 
 #include "pa_watcher.h"
+#include "probes.h"
 #include "verbar.h"
 
 struct volume_section {
@@ -46,7 +47,7 @@ static int volume_epoll_callback(int fd, void *data, uint32_t events)
 	return volume_update(data);
 }
 
-static void *volume_init(int epoll_fd)
+static void *volume_init(int epoll_fd, char * const *options)
 {
 	struct volume_section *section;
 	struct epoll_event ev;
@@ -93,6 +94,7 @@ static void *volume_init(int epoll_fd)
 	section->epoll.callback = volume_epoll_callback;
 	section->epoll.fd = pipefd[0];
 	section->epoll.data = section;
+	section->epoll.name = "volume";
 	ev.events = EPOLLIN;
 	ev.data.ptr = &section->epoll;
 
@@ -118,6 +120,9 @@ static int volume_update(struct volume_section *section)
 {
 	struct pa_volume volume;
 	ssize_t ssret;
+	int status = 0;
+
+	PROBE(pa__message__start);
 
 	/*
 	 * TODO: keep reading while there's stuff in the pipe and just use the
@@ -126,18 +131,30 @@ static int volume_update(struct volume_section *section)
 	ssret = read(section->epoll.fd, &volume, sizeof(volume));
 	if (ssret == -1) {
 		perror("read(pa_watcher)");
-		return -1;
+		status = -1;
+		goto out;
 	}
 	if (ssret != sizeof(volume)) {
 		fprintf(stderr, "short read from pa_watcher\n");
-		return -1;
+		status = -1;
+		goto out;
 	}
 
+	if (section->muted == volume.muted && section->volume == volume.volume)
+		goto out;
+
 	section->muted = volume.muted;
 	section->volume = volume.volume;
 
-	request_update();
+	section_dirty(section);
 
+out:
+	PROBE1(pa__message__end, status);
+	if (status) {
+		/* pa_watcher died; start it again with backoff. */
+		unwatch_fd(&section->epoll);
+		return section_failed(section);
+	}
 	return 0;
 }
 
@@ -158,10 +175,27 @@ static int volume_append(void *data, struct str *str, bool wordy)
 	return str_separator(str);
 }
 
+static size_t volume_values(void *data, struct section_value *values,
+			    size_t max)
+{
+	struct volume_section *section = data;
+
+	if (max < 2)
+		return 0;
+	values[0].key = "volume";
+	values[0].value = section->volume;
+	values[1].key = "muted";
+	values[1].value = section->muted;
+	return 2;
+}
+
 static const struct section volume_section = {
 	.name = "volume",
 	.init = volume_init,
 	.free = volume_free,
+	/* The child runs libpulse without exec. */
+	.main_thread_init = true,
 	.append = volume_append,
+	.values = volume_values,
 };
 register_section(volume_section);
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2026 Omar Sandoval
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "verbar_internal.h"
+
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER;
+static struct work *pending_head, **pending_tail = &pending_head;
+static bool stopping;
+
+static pthread_t *threads;
+static unsigned int num_threads;
+
+/* Work which has been queued but not handed back yet (main thread only). */
+static unsigned int num_outstanding;
+
+/*
+ * Lock-free stack of completed work. Workers push onto it and the main thread
+ * takes the whole stack at once, so there is no ABA problem.
+ */
+static struct work *completed;
+
+static int completion_callback(int fd, void *data, uint32_t events);
+
+static struct epoll_callback completion_cb = {
+	.callback = completion_callback,
+	.fd = -1,
+	.name = "worker completion",
+};
+
+static void push_completed(struct work *work)
+{
+	struct work *head;
+	uint64_t one = 1;
+	ssize_t ssret;
+
+	head = __atomic_load_n(&completed, __ATOMIC_RELAXED);
+	do {
+		work->next = head;
+	} while (!__atomic_compare_exchange_n(&completed, &head, work, true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+	ssret = write(completion_cb.fd, &one, sizeof(one));
+	if (ssret == -1)
+		perror("write(eventfd)");
+}
+
+static void *worker_thread(void *arg)
+{
+	struct work *work;
+
+	for (;;) {
+		pthread_mutex_lock(&pending_lock);
+		while (!pending_head && !stopping)
+			pthread_cond_wait(&pending_cond, &pending_lock);
+		if (stopping) {
+			pthread_mutex_unlock(&pending_lock);
+			return NULL;
+		}
+		work = pending_head;
+		pending_head = work->next;
+		if (!pending_head)
+			pending_tail = &pending_head;
+		pthread_mutex_unlock(&pending_lock);
+
+		work->run(work);
+		push_completed(work);
+	}
+}
+
+static int completion_callback(int fd, void *data, uint32_t events)
+{
+	struct work *work, *prev, *next;
+	uint64_t count;
+	ssize_t ssret;
+
+	ssret = read(fd, &count, sizeof(count));
+	if (ssret == -1) {
+		perror("read(eventfd)");
+		return -1;
+	}
+	assert(ssret == sizeof(count));
+
+	/* Reverse the stack so that work completes in order. */
+	work = __atomic_exchange_n(&completed, NULL, __ATOMIC_ACQUIRE);
+	prev = NULL;
+	while (work) {
+		next = work->next;
+		work->next = prev;
+		prev = work;
+		work = next;
+	}
+
+	for (work = prev; work; work = next) {
+		next = work->next;
+		num_outstanding--;
+		if (work->done(work))
+			return -1;
+	}
+	return 0;
+}
+
+int start_workers(int epoll_fd, unsigned int count)
+{
+	struct epoll_event ev;
+	int ret;
+
+	if (!count || threads)
+		return 0;
+
+	completion_cb.fd = eventfd(0, EFD_CLOEXEC);
+	if (completion_cb.fd == -1) {
+		perror("eventfd");
+		return -1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &completion_cb;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, completion_cb.fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+
+	threads = calloc(count, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return -1;
+	}
+	stopping = false;
+	for (num_threads = 0; num_threads < count; num_threads++) {
+		ret = pthread_create(&threads[num_threads], NULL,
+				     worker_thread, NULL);
+		if (ret) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void stop_workers(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&pending_lock);
+	stopping = true;
+	pending_head = NULL;
+	pending_tail = &pending_head;
+	pthread_cond_broadcast(&pending_cond);
+	pthread_mutex_unlock(&pending_lock);
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	threads = NULL;
+	num_threads = 0;
+	num_outstanding = 0;
+	completed = NULL;
+
+	if (completion_cb.fd != -1) {
+		close(completion_cb.fd);
+		completion_cb.fd = -1;
+	}
+}
+
+void suspend_workers(void)
+{
+	unsigned int i;
+
+	assert(!num_outstanding);
+	pthread_mutex_lock(&pending_lock);
+	stopping = true;
+	pthread_cond_broadcast(&pending_cond);
+	pthread_mutex_unlock(&pending_lock);
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+}
+
+int resume_workers(void)
+{
+	unsigned int i;
+	int ret;
+
+	stopping = false;
+	for (i = 0; i < num_threads; i++) {
+		ret = pthread_create(&threads[i], NULL, worker_thread, NULL);
+		if (ret) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+			num_threads = i;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+bool have_workers(void)
+{
+	return num_threads > 0;
+}
+
+unsigned int outstanding_work(void)
+{
+	return num_outstanding;
+}
+
+void queue_work(struct work *work)
+{
+	work->next = NULL;
+	num_outstanding++;
+	pthread_mutex_lock(&pending_lock);
+	*pending_tail = work;
+	pending_tail = &work->next;
+	pthread_cond_signal(&pending_cond);
+	pthread_mutex_unlock(&pending_lock);
+}